@@ -1,6 +1,56 @@
 #include "BPlusTree.h"
+#include "BPlusTreeCursor.h"
+#include <thread>
+
+// NodeHeader::version of a node: bit 0 is set once the node is released, bit 1 while a writer has it latched,
+// and the bits above count the changes made to the node, so a reader can tell that a node changed since it read its version
+static const uint64_t VERSION_OBSOLETE = 1;
+static const uint64_t VERSION_LOCKED = 2;
+
+// Nodes with at most this many keys are searched by counting, larger ones by binary search
+static const unsigned int MAX_KEYS_COUNTED = 16;
+
+// Index of the first of numKeys sorted keys that is greater than numVotes, i.e. the number of keys <= numVotes
+// Neither search branches on the keys: a small node is searched by counting the keys <= numVotes with independent compares,
+// a larger one by a binary search that halves the range with a conditional move, so there is no jump for the CPU to mispredict
+unsigned int BPlusTree::upperBound(const unsigned int* numVotesArr, unsigned int numKeys, unsigned int numVotes) {
+    if (numKeys <= MAX_KEYS_COUNTED) {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < numKeys; i++) count += numVotesArr[i] <= numVotes;
+        return count;
+    }
+    const unsigned int* base = numVotesArr;
+    while (numKeys > 1) {
+        unsigned int half = numKeys / 2;
+        base += (base[half - 1] <= numVotes) ? half : 0;
+        numKeys -= half;
+    }
+    return (base - numVotesArr) + (*base <= numVotes);
+}
+
+// Index of the first of numKeys sorted keys that is not smaller than numVotes, searched like upperBound()
+unsigned int BPlusTree::lowerBound(const unsigned int* numVotesArr, unsigned int numKeys, unsigned int numVotes) {
+    if (numKeys <= MAX_KEYS_COUNTED) {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < numKeys; i++) count += numVotesArr[i] < numVotes;
+        return count;
+    }
+    const unsigned int* base = numVotesArr;
+    while (numKeys > 1) {
+        unsigned int half = numKeys / 2;
+        base += (base[half - 1] < numVotes) ? half : 0;
+        numKeys -= half;
+    }
+    return (base - numVotesArr) + (*base < numVotes);
+}
+
+static const char TREE_MAGIC[8] = "BPTREE1";
 
-BPlusTree::BPlusTree(unsigned int nodeSize) {
+BPlusTree::BPlusTree(unsigned int nodeSize, DiskSimulator* disk, BufferPool* bufferPool, int segmentId) {
+    this->disk = disk;
+    this->bufferPool = bufferPool;
+    this->segmentId = segmentId;
+    freeNodes = -1;
     numNodes = 0;
     numOverflowNodes = 0;
     numIndexAccessed = 0;
@@ -13,37 +63,139 @@ BPlusTree::BPlusTree(unsigned int nodeSize) {
     sizeOfNode = nodeSize;
     const int sizeOfKeyPtrPair = (sizeof(pointerBlockPair) + sizeof(unsigned int)); 
     maxKeys = (nodeSize - sizeof(NodeHeader) - sizeof(pointerBlockPair)) / sizeOfKeyPtrPair;  
-    root = getNewNode(true, false);
+
+    // The header block is the first block of the segment, the tree of a reopened disk is used as it is
+    // if its last run closed it, it is read before anything is pinned, like the hash index's buckets
+    vector<int> blockIds = disk->getSegmentBlockIds(segmentId);
+    bPlusTreeHeader* header = blockIds.empty() ? nullptr : (bPlusTreeHeader*) disk->fetchBlockAddress(blockIds[0]);
+    isLoaded = header != nullptr && memcmp(header->magic, TREE_MAGIC, sizeof(TREE_MAGIC)) == 0
+        && header->maxKeys == maxKeys && header->isClosed;
+    if (isLoaded) {
+        headerId = blockIds[0];
+        root = header->rootId;
+        height = header->height;
+        numNodes = header->numNodes;
+        numOverflowNodes = header->numOverflowNodes;
+        freeNodes = header->freeNodes;
+        // written straight to disk, so that the tree is rebuilt if this run ends without closing it
+        header->isClosed = 0;
+        return;
+    }
+
+    // Nodes left by a run that did not close its tree may not match the data blocks,
+    // so they are released and the tree is built again from the data blocks
+    for (int blockId : blockIds) {
+        bufferPool->discardBlock(disk->fetchBlockAddress(blockId));
+        disk->updateMapTable(disk->fetchBlockAddress(blockId));
+    }
+    void* headerAddress = disk->getUnusedBlock(segmentId);
+    if (headerAddress == nullptr) {
+        printf("Disk is full, the B+ Tree cannot be created!\n");
+        exit(1);
+    }
+    disk->updateMapTable(headerAddress);
+    headerId = disk->getBlockId(headerAddress);
+    header = (bPlusTreeHeader*) bufferPool->pinNewBlock(headerAddress);
+    memcpy(header->magic, TREE_MAGIC, sizeof(TREE_MAGIC));
+    header->maxKeys = maxKeys;
+    header->isClosed = 0;
+    bufferPool->unpinBlock(headerAddress, true);
+
+    getNewNode(true, false, root);
+    unpinNode(root, true);
+}
+
+// Records the root, the counts and the free list in the header block, so that the tree can be used again after reopening
+// The buffer pool writes it back with the nodes when it is deleted, so the tree must be deleted first
+BPlusTree::~BPlusTree() {
+    bPlusTreeHeader* header = (bPlusTreeHeader*) pinNode(headerId);
+    header->rootId = root;
+    header->height = height;
+    header->numNodes = numNodes;
+    header->numOverflowNodes = numOverflowNodes;
+    header->freeNodes = freeNodes;
+    header->isClosed = 1;
+    unpinNode(headerId, true);
 }
 
-// Gets a new node from memory to be used as a node in the B+ Tree
+// Pins a node in the buffer pool and returns the frame holding it, which stays valid until unpinNode()
+void* BPlusTree::pinNode(int nodeId) {
+    void* node = bufferPool->pinBlock(disk->fetchBlockAddress(nodeId));
+    if (node == nullptr) {
+        printf("Buffer pool is full, the B+ Tree cannot read a node!\n");
+        exit(1);
+    }
+    return node;
+}
+
+void BPlusTree::unpinNode(int nodeId, bool isDirty) {
+    bufferPool->unpinBlock(disk->fetchBlockAddress(nodeId), isDirty);
+}
+
+// Gets a new node to be used as a node in the B+ Tree, a node released by a deletion if there is one, else a new disk block of the index segment
 // isOverflow used to determine whether to increment numOverflowNodes or numNodes
 // isLeaf is also assigned for the node based on the input
-void* BPlusTree::getNewNode(bool isLeaf, bool isOverflow) {
-    void* addr = malloc(sizeOfNode);
+// Returns the node pinned, with its id in nodeId, the caller unpins it as dirty
+void* BPlusTree::getNewNode(bool isLeaf, bool isOverflow, int &nodeId) {
+    lock_guard<mutex> guard(allocationLatch);
+    NodeHeader* header;
+    if (freeNodes != -1) {
+        nodeId = freeNodes;
+        header = (NodeHeader*) pinNode(nodeId);
+        freeNodes = *(int*)header;
+        // a reader may still hold the released node, its version moves on so that the reader sees the change
+        __atomic_store_n(&header->version, (header->version | VERSION_OBSOLETE | VERSION_LOCKED) + 1, __ATOMIC_RELEASE);
+    } else {
+        void* addr = disk->getUnusedBlock(segmentId);
+        if (addr == nullptr) {
+            printf("Disk is full, the B+ Tree cannot grow!\n");
+            exit(1);
+        }
+        header = (NodeHeader*) bufferPool->pinNewBlock(addr);
+        if (header == nullptr) {
+            printf("Buffer pool is full, the B+ Tree cannot grow!\n");
+            exit(1);
+        }
+        disk->updateMapTable(addr);
+        nodeId = disk->getBlockId(addr);
+        header->version = 0;
+    }
     
     // Initialise header of the node
-    NodeHeader* header;
-    header = (NodeHeader*) addr;
     header->numKeys = 0; // First 4 bytes (size of int) is numOfRecords = 0 
     header->isLeaf = isLeaf;
     
     // Initialise the pointer to parent
     pointerBlockPair ptr;
-    ptr.blockAddress = nullptr;
+    ptr.blockId = -1;
     ptr.recordID = -1;
     header->pointerToParent = ptr;
     
     // Initialise last pointer to null
     // Required for leaf nodes in case it is the last leaf node
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) addr ) + 1 );
-    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
-    ptrArr[maxKeys] = {nullptr, -1};
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (header + 1 );
+    ptrArr[maxKeys] = {-1, -1, 0, RATING_NOT_INCLUDED};
 
     // Incrementing number of nodes created for the B+ Tree
     isOverflow ? numOverflowNodes++ : numNodes++;
      
-    return addr;
+    return header;
+}
+
+
+// Releases a node that is no longer part of the B+ Tree, it goes on the free list once the latches of the structure change are released
+// and getNewNode() reuses it before taking another disk block
+// The node's block stays in the index segment, the first bytes of the node hold the next node of the list
+void BPlusTree::releaseNode(int nodeId) {
+    releasedNodes.push_back(nodeId);
+}
+
+
+// Asks for a node to be loaded ahead of a later visit to it, so that the visit does not stall
+// Used by BPlusTreeCursor to load the next leaf and overflow nodes while the current leaf is processed
+void BPlusTree::prefetchNode(int nodeId) {
+    if (nodeId == -1) return;
+    bufferPool->prefetchBlock(disk->fetchBlockAddress(nodeId));
 }
 
 
@@ -58,7 +210,7 @@ int BPlusTree::printIndexBlock(void* node, ofstream &output) {
     if (output.is_open())
         output << " | ";
     char toPrint[24];
-    for (int i=0; i<maxKeys; i++) {
+    for (int i=0; i<(int) maxKeys; i++) {
         if (i < numKeys) {
             snprintf(toPrint, 24, "%6u | ", numVotesArr[i]);
         } else {
@@ -72,215 +224,513 @@ int BPlusTree::printIndexBlock(void* node, ofstream &output) {
     return numKeys;
 }
 
+// Print the contents of the root node
+// Used for experiments
+void BPlusTree::printRoot(ofstream &output) {
+    printIndexBlock(pinNode(root), output);
+    unpinNode(root, false);
+}
+
 
 // Queries a record/range of keys that is selected by the user
 // This may return multiple pointerBlockPaires due to the possibility of multiple records having same key value of numVotes
 // For querying of single value, set numVotesStart and numVotesEnd to both be the value
-// Calls findNode() to locate the appropiate leaf node
+// Collects every entry of the range with a BPlusTreeCursor, callers that do not need them all at once should use the cursor
 list<pointerBlockPair> BPlusTree::findRecord(unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output) {
     
-    numIndexAccessed = 0; 
-    numOverflowNodesAccessed = 0;
-    
     list<pointerBlockPair> results;
-    void* currNode = findNode(numVotesStart, root, 0, output, false);
-    
-    unsigned int numKeys = *(unsigned int *)currNode;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) currNode ) + 1 );
-    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+    BPlusTreeCursor cursor(this);
+    cursor.seek(numVotesStart, numVotesEnd);
+    pointerBlockPair entry;
+    while (cursor.next(entry)) {
+        results.push_back(entry);
+    }
+
+    numIndexAccessed = cursor.numIndexAccessed;
+    numOverflowNodesAccessed = cursor.numOverflowNodesAccessed;
+    cursor.printStatistics(output);
+    return results;
+}
+
+
+// Finds the leaf node that numVotes belongs in, the lookup path of retrieval, insertion and deletion
+// Walks down iteratively with upperBound() in every node
+// This DOES NOT mean that the key is definitely present in the node, iteration through the node still needs to be done
+int BPlusTree::findLeaf(unsigned int numVotes) {
+    int nodeId = root;
+    for (unsigned int currHeight = 0; currHeight < height; currHeight++) {
+        void* node = pinNode(nodeId);
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+        unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+        // the child left of the first key greater than numVotes, the last child if there is none
+        int childId = ptrArr[upperBound(numVotesArr, *(unsigned int*) node, numVotes)].blockId;
+        unpinNode(nodeId, false);
+        nodeId = childId;
+    }
+    return nodeId;
+}
+
+
+// Reads the version of a node before reading the node, waiting while a writer has it latched
+// Returns false if the node was released, the reader has to start again from the root
+bool BPlusTree::readLock(void* node, uint64_t &version) {
+    version = __atomic_load_n(&((NodeHeader*) node)->version, __ATOMIC_ACQUIRE);
+    while (version & VERSION_LOCKED) {
+        this_thread::yield();
+        version = __atomic_load_n(&((NodeHeader*) node)->version, __ATOMIC_ACQUIRE);
+    }
+    return (version & VERSION_OBSOLETE) == 0;
+}
+
+// Returns true if the node has not changed since readLock() gave version, i.e. what was read from it is consistent
+bool BPlusTree::validate(void* node, uint64_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&((NodeHeader*) node)->version, __ATOMIC_RELAXED) == version;
+}
+
+// Latches a node that has not changed since readLock() gave version, returns false if it has
+bool BPlusTree::upgradeLock(void* node, uint64_t version) {
+    return __atomic_compare_exchange_n(&((NodeHeader*) node)->version, &version, version + VERSION_LOCKED,
+        false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void BPlusTree::writeLock(void* node) {
+    uint64_t version;
+    do {
+        readLock(node, version);
+    } while (!upgradeLock(node, version));
+}
 
-    int i = 0;
-
-    // Continue iterating when key is smaller than search key and the current non-full node has not reached the end
-    while ( i < numKeys && numVotesArr[i] <= numVotesEnd) { 
-        if (numVotesArr[i] >= numVotesStart){   // Check if key is greater than starting key
-            if (ptrArr[i].recordID == -1){ // If duplicates exist, need to traverse overflowNodes
-                void* currOverflowNode = ptrArr[i].blockAddress;
-                unsigned int numKeysOverflow;
-                pointerBlockPair* ptrArrOverflow;
-
-                // Traverse all overflowNodes and add their records into results
-                while (currOverflowNode != nullptr){
-                    numOverflowNodesAccessed++;
-                    numKeysOverflow = *(unsigned int *)currOverflowNode;
-                    ptrArrOverflow = (pointerBlockPair*) (((NodeHeader*) currOverflowNode ) + 1 );
-                    for (int j = 0; j < numKeysOverflow; j++){
-                        results.push_back(ptrArrOverflow[j]);
-                    }                   
-                    currOverflowNode = ptrArrOverflow[maxKeys].blockAddress;
+// Unlatches a node and moves its version on, marking it as released if isObsolete
+void BPlusTree::writeUnlock(void* node, bool isObsolete) {
+    __atomic_fetch_add(&((NodeHeader*) node)->version, isObsolete ? VERSION_LOCKED + VERSION_OBSOLETE : VERSION_LOCKED, __ATOMIC_RELEASE);
+}
+
+// Latches a node for the structure change in progress and returns its frame, the node stays pinned and latched until releaseLatches()
+void* BPlusTree::latchNode(int nodeId) {
+    for (pair<int, void*> &latched : latchedNodes) {
+        if (latched.first == nodeId) return latched.second;
+    }
+    void* node = pinNode(nodeId);
+    writeLock(node);
+    latchedNodes.push_back({nodeId, node});
+    return node;
+}
+
+// Ends a structure change: unlatches and unpins its nodes, then puts the nodes it released on the free list
+void BPlusTree::releaseLatches() {
+    for (pair<int, void*> &latched : latchedNodes) {
+        writeUnlock(latched.second, find(releasedNodes.begin(), releasedNodes.end(), latched.first) != releasedNodes.end());
+        unpinNode(latched.first, true);
+    }
+    latchedNodes.clear();
+
+    lock_guard<mutex> guard(allocationLatch);
+    for (int nodeId : releasedNodes) {
+        NodeHeader* header = (NodeHeader*) pinNode(nodeId);
+        // overflow nodes are only reached through their latched leaf and are not latched themselves
+        if ((__atomic_load_n(&header->version, __ATOMIC_RELAXED) & VERSION_OBSOLETE) == 0) {
+            writeLock(header);
+            writeUnlock(header, true);
+        }
+        *(int*)header = freeNodes;
+        freeNodes = nodeId;
+        unpinNode(nodeId, true);
+    }
+    releasedNodes.clear();
+}
+
+// Finds the leaf node that numVotes belongs in while other threads may be changing the tree, with optimistic lock coupling:
+// the version of every node is read before the node and checked again after, and a child is only used once its parent
+// is known not to have changed, returns false if a writer got in the way and the search has to start again
+// The leaf is returned pinned with its version, for the caller to check or to latch the leaf with upgradeLock(), and then unpin
+bool BPlusTree::findLeafOptimistic(unsigned int numVotes, int &leafId, void* &leaf, uint64_t &version) {
+    int nodeId = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+    void* node = pinNode(nodeId);
+    uint64_t nodeVersion;
+    if (!readLock(node, nodeVersion) || nodeId != __atomic_load_n(&root, __ATOMIC_ACQUIRE)) {
+        unpinNode(nodeId, false);
+        return false;
+    }
+
+    while (!((NodeHeader*) node)->isLeaf) {
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+        unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+        // numKeys may be torn by a writer, it is kept within the node until the version check catches the change
+        unsigned int numKeys = min(*(unsigned int*) node, maxKeys);
+        int childId = ptrArr[upperBound(numVotesArr, numKeys, numVotes)].blockId;
+
+        // the child id is only pinned once it is known to be one the node really had
+        if (!validate(node, nodeVersion)) {
+            unpinNode(nodeId, false);
+            return false;
+        }
+        void* child = pinNode(childId);
+        uint64_t childVersion;
+        bool isValid = readLock(child, childVersion) && validate(node, nodeVersion);
+        unpinNode(nodeId, false);
+        if (!isValid) {
+            unpinNode(childId, false);
+            return false;
+        }
+        nodeId = childId;
+        node = child;
+        nodeVersion = childVersion;
+    }
+    leafId = nodeId;
+    leaf = node;
+    version = nodeVersion;
+    return true;
+}
+
+// Appends the entries of every key from numVotesStart to numVotesEnd to entries, in key order
+// Safe to use while other threads insert and delete keys: each leaf is read with its overflow nodes and checked afterwards,
+// if a writer changed it meanwhile the entries read from it are dropped and the search starts again from its first key
+void BPlusTree::findRange(unsigned int numVotesStart, unsigned int numVotesEnd, vector<pointerBlockPair> &entries) {
+    unsigned int numVotes = numVotesStart; // smallest key whose entries have not been read yet
+    int leafId;
+    void* leaf;
+    uint64_t version;
+    while (true) {
+        if (!findLeafOptimistic(numVotes, leafId, leaf, version)) continue;
+
+        while (true) {
+            size_t numEntriesRead = entries.size();
+            pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+            unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+            unsigned int numKeys = min(*(unsigned int*) leaf, maxKeys);
+            bool isChanged = false;
+            bool isEndReached = false;
+
+            for (unsigned int i = lowerBound(numVotesArr, numKeys, numVotes); i < numKeys && !isChanged; i++) {
+                if (numVotesArr[i] > numVotesEnd) {
+                    isEndReached = true;
+                    break;
+                }
+                if (ptrArr[i].recordID != -1) {
+                    entries.push_back(ptrArr[i]);
+                    continue;
+                }
+                // Overflow nodes are only changed with their leaf latched, so the leaf's version covers them too
+                int overflowId = ptrArr[i].blockId;
+                while (overflowId != -1) {
+                    if (!validate(leaf, version)) {
+                        isChanged = true;
+                        break;
+                    }
+                    void* overflowNode = pinNode(overflowId);
+                    pointerBlockPair* ptrArrOverflow = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+                    unsigned int numKeysOverflow = min(*(unsigned int*) overflowNode, maxKeys);
+                    entries.insert(entries.end(), ptrArrOverflow, ptrArrOverflow + numKeysOverflow);
+                    int nextOverflowId = ptrArrOverflow[maxKeys].blockId;
+                    unpinNode(overflowId, false);
+                    overflowId = nextOverflowId;
                 }
-            } else { // Duplicate keys do not exist
-                results.push_back(ptrArr[i]);
             }
+            int nextLeafId = ptrArr[maxKeys].blockId;
+            unsigned int lastKey = numKeys > 0 ? numVotesArr[numKeys-1] : 0;
+
+            if (isChanged || !validate(leaf, version)) {
+                entries.resize(numEntriesRead);
+                unpinNode(leafId, false);
+                break;
+            }
+            if (isEndReached || nextLeafId == -1 || (numKeys > 0 && lastKey >= numVotesEnd)) {
+                unpinNode(leafId, false);
+                return;
+            }
+
+            // Every key of the next leaf is greater than the keys of this one
+            if (numKeys > 0) numVotes = lastKey + 1;
+            void* nextLeaf = pinNode(nextLeafId);
+            uint64_t nextVersion;
+            bool isValid = readLock(nextLeaf, nextVersion) && validate(leaf, version);
+            unpinNode(leafId, false);
+            if (!isValid) {
+                unpinNode(nextLeafId, false);
+                break;
+            }
+            leafId = nextLeafId;
+            leaf = nextLeaf;
+            version = nextVersion;
         }
+    }
+}
 
-        //End of the current leaf node has been reached, need to traverse to next leaf node
-        if (i == numKeys-1) {
-            currNode = ptrArr[maxKeys].blockAddress; //Traverse to the next leaf node
 
-            // Reset the search to start of the next leaf node
-            ptrArr = (pointerBlockPair*) (((NodeHeader*)  currNode ) + 1 );
-            numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
-            numKeys = *(unsigned int *)currNode;
-            i = 0;            
-            continue;
+// Finds the leaf node of each of numKeys keys, the same one findLeaf() would, into leaves
+// The keys walk down the tree together a level at a time, each prefetching the child it goes to next,
+// so the cache misses of all the keys at a level overlap instead of being waited for one after another
+void BPlusTree::findLeaves(const unsigned int* numVotes, int numKeys, int* leaves) {
+    for (int k = 0; k < numKeys; k++) {
+        leaves[k] = root;
+    }
+    for (unsigned int currHeight = 0; currHeight < height; currHeight++) {
+        for (int k = 0; k < numKeys; k++) {
+            void* node = pinNode(leaves[k]);
+            pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+            unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+            int childId = ptrArr[upperBound(numVotesArr, *(unsigned int*) node, numVotes[k])].blockId;
+            unpinNode(leaves[k], false);
+            leaves[k] = childId;
+            prefetchNode(childId);
         }
-        i++;
     }
+}
+
+
+// Looks up many single numVotes values at once, in any order, and returns the entries of each key in the same position
+// Keys are looked up BATCH_GROUP_SIZE at a time with findLeaves(), and the first overflow node of every duplicate key
+// in a group is prefetched before any of them is read
+vector<vector<pointerBlockPair>> BPlusTree::findRecordsBatch(const vector<unsigned int> &numVotes) {
+    vector<vector<pointerBlockPair>> results(numVotes.size());
+    int leaves[BATCH_GROUP_SIZE];
+    int overflowIds[BATCH_GROUP_SIZE]; // first overflow node of each key of the group, -1 if it has none
+
+    for (size_t first = 0; first < numVotes.size(); first += BATCH_GROUP_SIZE) {
+        int groupSize = min((size_t) BATCH_GROUP_SIZE, numVotes.size() - first);
+        findLeaves(&numVotes[first], groupSize, leaves);
+
+        // Keys without duplicates get their entry here, the overflow nodes of the others are read once all are prefetched
+        for (int k = 0; k < groupSize; k++) {
+            void* leaf = pinNode(leaves[k]);
+            pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+            unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+            unsigned int numKeys = *(unsigned int*) leaf;
+            unsigned int i = lowerBound(numVotesArr, numKeys, numVotes[first + k]);
+            overflowIds[k] = -1;
+            if (i < numKeys && numVotesArr[i] == numVotes[first + k]) {
+                if (ptrArr[i].recordID != -1) {
+                    results[first + k].push_back(ptrArr[i]);
+                } else {
+                    overflowIds[k] = ptrArr[i].blockId;
+                    prefetchNode(overflowIds[k]);
+                }
+            }
+            unpinNode(leaves[k], false);
+        }
 
-    if (output.is_open()) {
-        output << "\nTotal number of index nodes accessed: " << numIndexAccessed << "\n";
-        output << "Total number of overflow index nodes accessed: " << numOverflowNodesAccessed << "\n";
-        output << "Total number of index + overflow nodes accessed: " << (numOverflowNodesAccessed + numIndexAccessed) << "\n";
-        cout << "\nTotal number of index nodes accessed: " << numIndexAccessed << "\n";
-        cout << "Total number of overflow nodes accessed: " << numOverflowNodesAccessed << "\n";
-        cout << "Total number of index + overflow nodes accessed: " << (numOverflowNodesAccessed + numIndexAccessed) << "\n";
+        for (int k = 0; k < groupSize; k++) {
+            // Duplicates of the key are in overflow nodes
+            int overflowId = overflowIds[k];
+            while (overflowId != -1) {
+                void* overflowNode = pinNode(overflowId);
+                pointerBlockPair* ptrArrOverflow = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+                prefetchNode(ptrArrOverflow[maxKeys].blockId);
+                results[first + k].insert(results[first + k].end(), ptrArrOverflow, ptrArrOverflow + *(unsigned int*) overflowNode);
+                int nextOverflowId = ptrArrOverflow[maxKeys].blockId;
+                unpinNode(overflowId, false);
+                overflowId = nextOverflowId;
+            }
+        }
     }
     return results;
 }
 
 
-// Finds the appropiate node to be used for retrieval/insertion/deletion
-// Starts from the root node and recursively calls findNode() every time it goes down a level
-// Terminating condition occurs when a leaf node is reached 
-// This DOES NOT mean that the key is definitely present in the node, iteration through the node still needs to be done
-void* BPlusTree::findNode(unsigned int numVotes, void* node, unsigned int currHeight, ofstream &output, bool willPrint) {
+// Finds the entries of the keys on either side of numVotes: before is an entry of the largest key <= numVotes in its leaf,
+// after an entry of the smallest key > numVotes, either has a blockId of -1 if there is no such key
+// For keys with duplicates, before is the last entry of the key's overflow nodes and after the first one
+// Used to place a record in the data block of its neighbours when the data blocks are clustered on numVotes
+void BPlusTree::findNeighbours(unsigned int numVotes, pointerBlockPair &before, pointerBlockPair &after) {
+    before = {-1, -1, 0, RATING_NOT_INCLUDED};
+    after = {-1, -1, 0, RATING_NOT_INCLUDED};
 
-    numIndexAccessed++;
+    int currNodeId = findLeaf(numVotes);
+    void* currNode = pinNode(currNodeId);
+    unsigned int numKeys = *(unsigned int *)currNode;
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) currNode ) + 1 );
+    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
 
-    // Print index blocks to screen and file
-    if(willPrint){
-        if (output.is_open()) {
-            printIndexBlock(node, output);
-            cout << endl;
-            output << endl;
+    unsigned int i = upperBound(numVotesArr, numKeys, numVotes);
+    if (i > 0) {
+        before = entryOfKey(ptrArr[i-1], true);
+    }
+    if (i == numKeys) {
+        // the next larger key is the first one of the next leaf
+        int nextNodeId = ptrArr[maxKeys].blockId;
+        unpinNode(currNodeId, false);
+        if (nextNodeId == -1) return;
+        currNodeId = nextNodeId;
+        currNode = pinNode(currNodeId);
+        ptrArr = (pointerBlockPair*) (((NodeHeader*) currNode ) + 1 );
+        i = 0;
+        if (*(unsigned int *)currNode == 0) {
+            unpinNode(currNodeId, false);
+            return;
         }
     }
+    after = entryOfKey(ptrArr[i], false);
+    unpinNode(currNodeId, false);
+}
 
-    // return terminal node
-    if (currHeight == height) {
-        return node;
+// Returns the entry of a leaf pointer, or the first or last entry of its overflow nodes if the key has duplicates
+pointerBlockPair BPlusTree::entryOfKey(pointerBlockPair leafPointer, bool isLast) {
+    if (leafPointer.recordID != -1) return leafPointer;
+
+    int overflowId = leafPointer.blockId;
+    void* overflowNode = pinNode(overflowId);
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+    while (isLast && ptrArr[maxKeys].blockId != -1) {
+        int nextOverflowId = ptrArr[maxKeys].blockId;
+        unpinNode(overflowId, false);
+        overflowId = nextOverflowId;
+        overflowNode = pinNode(overflowId);
+        ptrArr = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
     }
-    
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
-    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
-    unsigned int numKeys = *((unsigned int*) node);
+    unsigned int numKeys = *(unsigned int *)overflowNode;
+    pointerBlockPair entry = {-1, -1, 0, RATING_NOT_INCLUDED};
+    if (numKeys > 0) {
+        entry = isLast ? ptrArr[numKeys-1] : ptrArr[0];
+    }
+    unpinNode(overflowId, false);
+    return entry;
+}
 
-    for (int i = 0; i <= numKeys - 1; i++) {
-        if (numVotes < numVotesArr[i]) { 
-            return findNode(numVotes, ptrArr[i].blockAddress, ++currHeight, output, willPrint); // Search into pointer left of current index
-        } else {
-            if (i != numKeys - 1) {
-                continue; // compare with next numVotes if the last numVotes has not been reached
-            } else {
-                return findNode(numVotes, ptrArr[i+1].blockAddress, ++currHeight, output, willPrint); // Search into pointer right of last numVotes
-            }
+
+// Inserts a key into the B+ Tree, safe to use from several threads at once
+// If the key fits in its leaf (a duplicate, or the leaf is not full), only the leaf is latched
+// Otherwise the insertion is a structure change: it waits for structureLatch, then latches the leaf, every full ancestor
+// that will split, and the first ancestor that is not full, which takes the key moved up by the splits
+void BPlusTree::insertRecord(unsigned int numVotes, pointerBlockPair record) {
+
+    while (true) {
+        int leafId;
+        void* leaf;
+        uint64_t version;
+        if (!findLeafOptimistic(numVotes, leafId, leaf, version)) continue;
+
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+        unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+        unsigned int numKeys = min(*(unsigned int*) leaf, maxKeys);
+        unsigned int i = lowerBound(numVotesArr, numKeys, numVotes);
+        bool isSplitNeeded = numKeys == maxKeys && !(i < numKeys && numVotesArr[i] == numVotes);
+        bool isValid = validate(leaf, version);
+        if (!isValid || isSplitNeeded || !upgradeLock(leaf, version)) {
+            unpinNode(leafId, false);
+            if (isValid && isSplitNeeded) break;
+            continue;
         }
+        insertIntoLeaf(leafId, leaf, numVotes, record);
+        writeUnlock(leaf, false);
+        unpinNode(leafId, true);
+        return;
     }
 
-    return nullptr;
+    lock_guard<mutex> guard(structureLatch);
+    int leafId = findLeaf(numVotes);
+    void* leaf = latchNode(leafId);
+    for (void* node = leaf; *(unsigned int*) node == maxKeys; ) {
+        int parentId = ((NodeHeader*) node)->pointerToParent.blockId;
+        if (parentId == -1) break; // the root splits, the new root is latched when it is made
+        node = latchNode(parentId);
+    }
+    insertIntoLeaf(leafId, leaf, numVotes, record);
+    releaseLatches();
 }
 
 
-// Inserts a key into the B+ Tree if it exists
+// Inserts a key into a leaf node, which the caller has latched
 // Accounts for duplicate keys and creates overflow nodes to hold duplicate keys if required
 // Leaf nodes will only hold unique key values, which may have pointers to overflow nodes if mutliple records have the same index 
 // Calls splitLeafNode() if number of keys exceeds the maximum number of keys the leaf node can hold
-void BPlusTree::insertRecord(unsigned int numVotes, pointerBlockPair record) {
+void BPlusTree::insertIntoLeaf(int nodeId, void* nodeToInsertAt, unsigned int numVotes, pointerBlockPair record) {
 
-    ofstream dummy;
-    void* nodeToInsertAt = findNode(numVotes, root, 0, dummy, true);
     int numKeys = *(unsigned int*)nodeToInsertAt;
     
     pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) nodeToInsertAt ) + 1 );
     unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
 
+    // Position of the first key >= numVotes, where the new key goes if it is not a duplicate
+    int i = lowerBound(numVotesArr, numKeys, numVotes);
+
     // Check if there will be duplicate keys after the new record is inserted
 
     // Case 1: Duplicate key detected in the B+ tree
-    for (int i = 0; i <= numKeys-1; i++) { 
-        if (numVotes == numVotesArr[i]){
-            // first check if the key alr has a overflow node
-            void* overflowNode;
-            pointerBlockPair* ptrArrO;
-            unsigned int* numVotesArrO;
-            unsigned int* numKeysO;
-            
-            if (ptrArr[i].recordID == -1) { //An overflowNode already exists
-                overflowNode = ptrArr[i].blockAddress;
-                ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
-
-                // Traverse to the last overflow block by following the last pointer
-                while (ptrArrO[maxKeys].blockAddress != nullptr) { 
-                    overflowNode = ptrArrO[maxKeys].blockAddress;
-                    ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
-                }
-
-                // Check if the last overflowNode has capacity for another duplicate record
-                numKeysO = (unsigned int*) overflowNode;
-                int posToInsert = 0;
-
-                if (*numKeysO == maxKeys) { // last overflowNode is full, a new overflowNode needs to be created
-                    void* newOverflowNode = getNewNode(true, true);                    
-                    ptrArrO[maxKeys].blockAddress = newOverflowNode; // Link previous overflowNode to newOverflowNode 
-
-                    // Reset pointer to newOverflowNode for insertion of key later
-                    ptrArrO = (pointerBlockPair*) (((NodeHeader*) newOverflowNode ) + 1 ); 
-                    numKeysO = (unsigned int*) newOverflowNode; 
-                    (*numKeysO) = 1; // newOverflowNode will consist of 1 key 
-                    ptrArrO[maxKeys] = {nullptr, -1}; // Set newOverflowNode to point to nullptr to indicate that it is the last overflowNode       
-
-                } else { // last overflowNode has enough space; insert key into this overflowNode
-                    posToInsert = *numKeysO;
-                    (*numKeysO)++; // increment number of keys in overflowNode
-                }         
-
-                // Perform insertion of key into the correct overflowNode
-                numVotesArrO = (unsigned int*) (ptrArrO + maxKeys + 1);
-                ptrArrO[posToInsert] = record;
-                numVotesArrO[posToInsert] = numVotes;   
-
-            // Key currently added is the first duplicate, to create an overflow node and link it to the leaf node
-            } else { 
-                overflowNode = getNewNode(true, true);
+    if (i < numKeys && numVotes == numVotesArr[i]){
+        // first check if the key alr has a overflow node
+        int overflowId;
+        void* overflowNode;
+        pointerBlockPair* ptrArrO;
+        unsigned int* numVotesArrO;
+        unsigned int* numKeysO;
+        
+        if (ptrArr[i].recordID == -1) { //An overflowNode already exists
+            overflowId = ptrArr[i].blockId;
+            overflowNode = pinNode(overflowId);
+            ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+
+            // Traverse to the last overflow block by following the last pointer
+            while (ptrArrO[maxKeys].blockId != -1) { 
+                int nextOverflowId = ptrArrO[maxKeys].blockId;
+                unpinNode(overflowId, false);
+                overflowId = nextOverflowId;
+                overflowNode = pinNode(overflowId);
                 ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
-                numVotesArrO = (unsigned int*) (ptrArrO + maxKeys + 1);
-                numKeysO = (unsigned int*) overflowNode;
-
-                // set first key-ptr pair of overflow block to point to the existing key and its record
-                ptrArrO[0] = ptrArr[i]; 
-                numVotesArrO[0] = numVotesArr[i];
-
-                // set second key-ptr pair of overflow block to point to new (duplicate) key
-                ptrArrO[1] = record; 
-                numVotesArrO[1] = numVotes;
-
-                ptrArr[i].blockAddress = overflowNode;
-                ptrArr[i].recordID = -1;
-                ptrArrO[maxKeys].blockAddress = nullptr;
-                ptrArrO[maxKeys].recordID = -1;
-                (*numKeysO) = 2; // Number of keys in overflowNode = 2 (1 for existing key, 1 for duplicate key)
             }
-            return;
-        } 
-    }
+
+            // Check if the last overflowNode has capacity for another duplicate record
+            numKeysO = (unsigned int*) overflowNode;
+            int posToInsert = 0;
+
+            if (*numKeysO == maxKeys) { // last overflowNode is full, a new overflowNode needs to be created
+                int newOverflowId;
+                void* newOverflowNode = getNewNode(true, true, newOverflowId);                    
+                ptrArrO[maxKeys].blockId = newOverflowId; // Link previous overflowNode to newOverflowNode 
+                unpinNode(overflowId, true);
+                overflowId = newOverflowId;
+
+                // Reset pointer to newOverflowNode for insertion of key later
+                ptrArrO = (pointerBlockPair*) (((NodeHeader*) newOverflowNode ) + 1 ); 
+                numKeysO = (unsigned int*) newOverflowNode; 
+                (*numKeysO) = 1; // newOverflowNode will consist of 1 key 
+                ptrArrO[maxKeys] = {-1, -1, 0, RATING_NOT_INCLUDED}; // Set newOverflowNode to point to nothing to indicate that it is the last overflowNode       
+
+            } else { // last overflowNode has enough space; insert key into this overflowNode
+                posToInsert = *numKeysO;
+                (*numKeysO)++; // increment number of keys in overflowNode
+            }         
+
+            // Perform insertion of key into the correct overflowNode
+            numVotesArrO = (unsigned int*) (ptrArrO + maxKeys + 1);
+            ptrArrO[posToInsert] = record;
+            numVotesArrO[posToInsert] = numVotes;   
+
+        // Key currently added is the first duplicate, to create an overflow node and link it to the leaf node
+        } else { 
+            overflowNode = getNewNode(true, true, overflowId);
+            ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+            numVotesArrO = (unsigned int*) (ptrArrO + maxKeys + 1);
+            numKeysO = (unsigned int*) overflowNode;
+
+            // set first key-ptr pair of overflow block to point to the existing key and its record
+            ptrArrO[0] = ptrArr[i]; 
+            numVotesArrO[0] = numVotesArr[i];
+
+            // set second key-ptr pair of overflow block to point to new (duplicate) key
+            ptrArrO[1] = record; 
+            numVotesArrO[1] = numVotes;
+
+            ptrArr[i].blockId = overflowId;
+            ptrArr[i].recordID = -1;
+            ptrArrO[maxKeys].blockId = -1;
+            ptrArrO[maxKeys].recordID = -1;
+            (*numKeysO) = 2; // Number of keys in overflowNode = 2 (1 for existing key, 1 for duplicate key)
+        }
+        unpinNode(overflowId, true);
+        return;
+    } 
     
     // Case 2: Unique key, but number of keys after insertion to node exceeds max number of keys allowed
-    if (numKeys == maxKeys){
-        splitLeafNode(numVotes, record, nodeToInsertAt, ptrArr, numVotesArr);
+    if (numKeys == (int) maxKeys){
+        splitLeafNode(numVotes, record, nodeId, ptrArr, numVotesArr);
         return;
     }
     
     // Case 3: Unique key, and node has sufficient space to hold new key
-    int i;
-    for (i = 0; i <= numKeys-1; i++) { //Find position within node to insert key
-        if (numVotes < numVotesArr[i]){
-            for (int j = numKeys; j > i; j--) { // Shift current keys back to accomondate new key
-                numVotesArr[j] = numVotesArr[j-1];
-                ptrArr[j] = ptrArr[j-1];                
-            }
-            break;
-        }
+    for (int j = numKeys; j > i; j--) { // Shift current keys back to accomondate new key
+        numVotesArr[j] = numVotesArr[j-1];
+        ptrArr[j] = ptrArr[j-1];                
     }
     numVotesArr[i] = numVotes;
     ptrArr[i] = record;
@@ -288,217 +738,385 @@ void BPlusTree::insertRecord(unsigned int numVotes, pointerBlockPair record) {
 }
 
 
-// Deletes a key from the B+ Tree if it exists
-// Accounts for deletion of key from both leaf and non-leaf nodes
-// Initial deleting of a key always starts from a leaf node
-// If merging was performed, deleteKey() may be called again in mergeNodes() for the parent node 
-void BPlusTree::deleteKey(unsigned int numVotes, void* nodeToDeleteFrom) {
+// Builds the B+ Tree bottom-up from (numVotes, record) pairs, instead of inserting them one by one
+// The pairs are sorted by numVotes, records with the same numVotes keep their order and fill overflow nodes completely,
+// then every level is packed left to right with about fillFactor * maxKeys keys per node
+// The tree must be empty, otherwise the pairs are inserted one by one with insertRecord()
+void BPlusTree::bulkLoad(vector<pair<unsigned int, pointerBlockPair>> &records, float fillFactor) {
 
-    unsigned int* numKeys = (unsigned int*)nodeToDeleteFrom;
-    NodeHeader header = *(NodeHeader*) nodeToDeleteFrom;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) nodeToDeleteFrom ) + 1 );
-    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
-    
-    // Search for node for deletion of key
-    bool keyExists = false;
-    int i;
-    for (i=0; i<*numKeys; i++) {
-        if (numVotesArr[i] == numVotes) {
-            keyExists = true;
-            break;
+    void* rootNode = pinNode(root);
+    unsigned int numKeysInRoot = *(unsigned int*)rootNode;
+    unpinNode(root, false);
+    if (numKeysInRoot != 0 || height != 0) {
+        for (pair<unsigned int, pointerBlockPair> &record : records) {
+            insertRecord(record.first, record.second);
         }
+        return;
     }
+    if (records.empty()) return;
+    lock_guard<mutex> guard(structureLatch);
+
+    stable_sort(records.begin(), records.end(), [](const pair<unsigned int, pointerBlockPair> &a, const pair<unsigned int, pointerBlockPair> &b) {
+        return a.first < b.first;
+    });
+
+    // Leaf entries: a key with duplicates points to its overflow nodes, like insertRecord() would have done
+    vector<pair<unsigned int, pointerBlockPair>> leafEntries;
+    for (size_t first = 0, last; first < records.size(); first = last) {
+        last = first + 1;
+        while (last < records.size() && records[last].first == records[first].first) {
+            last++;
+        }
+        if (last - first == 1) {
+            leafEntries.push_back(records[first]);
+            continue;
+        }
+
+        int firstOverflowId = -1;
+        int prevOverflowId = -1;
+        pointerBlockPair* ptrArrPrev = nullptr;
+        for (size_t i = first; i < last; i += maxKeys) {
+            int overflowId;
+            void* overflowNode = getNewNode(true, true, overflowId);
+            pointerBlockPair* ptrArrO = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
+            unsigned int* numVotesArrO = (unsigned int*) (ptrArrO + maxKeys + 1);
+            unsigned int numKeysO = min((size_t) maxKeys, last - i);
+            for (unsigned int j = 0; j < numKeysO; j++) {
+                ptrArrO[j] = records[i + j].second;
+                numVotesArrO[j] = records[i + j].first;
+            }
+            *(unsigned int*)overflowNode = numKeysO;
+
+            if (ptrArrPrev == nullptr) {
+                firstOverflowId = overflowId;
+            } else {
+                ptrArrPrev[maxKeys].blockId = overflowId; // Link previous overflowNode to this one
+                unpinNode(prevOverflowId, true);
+            }
+            prevOverflowId = overflowId;
+            ptrArrPrev = ptrArrO;
+        }
+        unpinNode(prevOverflowId, true);
+        leafEntries.push_back({records[first].first, {firstOverflowId, -1, 0, RATING_NOT_INCLUDED}});
+    }
+
+    // The empty root leaf is replaced by the new levels
+    releaseNode(root);
+    numNodes--;
+    root = -1;
+
+    // Leaf level, the next pointers link the leaves left to right
+    unsigned int minLeafKeys = (maxKeys+1)/2;
+    unsigned int keysPerLeaf = max(minLeafKeys, min(maxKeys, (unsigned int) lround(maxKeys * fillFactor)));
+    vector<unsigned int> nodeSizes = packedNodeSizes(leafEntries.size(), keysPerLeaf, minLeafKeys);
+    vector<int> level;
+    vector<unsigned int> smallestKeys; // smallest key in the subtree of each node of the level, the separators of the level above
+    size_t next = 0;
+    pointerBlockPair* ptrArrPrev = nullptr;
+    for (unsigned int nodeSize : nodeSizes) {
+        int leafId;
+        void* leaf = getNewNode(true, false, leafId);
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+        unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+        for (unsigned int i = 0; i < nodeSize; i++, next++) {
+            numVotesArr[i] = leafEntries[next].first;
+            ptrArr[i] = leafEntries[next].second;
+        }
+        *(unsigned int*)leaf = nodeSize;
+
+        // the previous leaf stays pinned until it is linked to this one
+        if (!level.empty()) {
+            ptrArrPrev[maxKeys].blockId = leafId;
+            unpinNode(level.back(), true);
+        }
+        level.push_back(leafId);
+        smallestKeys.push_back(numVotesArr[0]);
+        ptrArrPrev = ptrArr;
+    }
+    unpinNode(level.back(), true);
+    height = 0;
+
+    // Non-leaf levels, a node with n keys has n+1 children
+    unsigned int minKeys = maxKeys/2;
+    unsigned int keysPerNode = max(minKeys, min(maxKeys, (unsigned int) lround(maxKeys * fillFactor)));
+    while (level.size() > 1) {
+        vector<int> parentLevel;
+        vector<unsigned int> parentSmallestKeys;
+        next = 0;
+        for (unsigned int nodeSize : packedNodeSizes(level.size(), keysPerNode + 1, minKeys + 1)) {
+            int nodeId;
+            void* node = getNewNode(false, false, nodeId);
+            pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+            unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+            for (unsigned int i = 0; i < nodeSize; i++, next++) {
+                ptrArr[i] = {level[next], -1, 0, RATING_NOT_INCLUDED};
+                setParent(level[next], nodeId);
+                if (i > 0) numVotesArr[i-1] = smallestKeys[next];
+            }
+            *(unsigned int*)node = nodeSize - 1;
+            unpinNode(nodeId, true);
+
+            parentSmallestKeys.push_back(smallestKeys[next - nodeSize]);
+            parentLevel.push_back(nodeId);
+        }
+        level = parentLevel;
+        smallestKeys = parentSmallestKeys;
+        height++;
+    }
+    __atomic_store_n(&root, level[0], __ATOMIC_RELEASE);
+    releaseLatches();
+}
+
+// Splits numItems into nodes of at most itemsPerNode items, spread evenly so that every node gets at least minItems
+// (a single node may have fewer), e.g. 15 items in nodes of 7 gives 5, 5 and 5
+vector<unsigned int> BPlusTree::packedNodeSizes(size_t numItems, unsigned int itemsPerNode, unsigned int minItems) {
+    size_t numNodes = (numItems + itemsPerNode - 1) / itemsPerNode;
+    while (numNodes > 1 && numItems / numNodes < minItems) {
+        numNodes--;
+    }
+    vector<unsigned int> nodeSizes(numNodes, numItems / numNodes);
+    for (size_t i = 0; i < numItems % numNodes; i++) {
+        nodeSizes[i]++;
+    }
+    return nodeSizes;
+}
+
+
+// Deletes a key and all of its records from the B+ Tree, safe to use while other threads use the tree
+// A deletion is a structure change: it waits for structureLatch and latches the path from the leaf to the root,
+// since the key may also be replaced in ancestors and merges can go up to the root, siblings are latched when borrowed from or merged
+void BPlusTree::removeKey(unsigned int numVotes) {
+    lock_guard<mutex> guard(structureLatch);
+    int leaf = findLeaf(numVotes);
+    int nodeId = leaf;
+    while (nodeId != -1) {
+        nodeId = ((NodeHeader*) latchNode(nodeId))->pointerToParent.blockId;
+    }
+    deleteKey(numVotes, leaf);
+    releaseLatches();
+}
+
+
+// Deletes a key from a leaf node of the B+ Tree if it exists, along with the overflow nodes of its duplicates
+// The caller has latched the leaf and its ancestors
+// Calls rebalanceNode() in case the leaf is left with too few keys
+void BPlusTree::deleteKey(unsigned int numVotes, int nodeToDeleteFrom) {
+
+    void* node = latchNode(nodeToDeleteFrom);
+    unsigned int* numKeys = (unsigned int*)node;
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+    
+    // Search for the key in the leaf node
+    unsigned int i = lowerBound(numVotesArr, *numKeys, numVotes);
 
     // If record does not exist, deletion cannot be done
-    if (!keyExists) {
+    if (i == *numKeys || numVotesArr[i] != numVotes) {
         printf("Record with numVotes = %u doesn't exist!\n", numVotes);
         return;
     }
-    
-    // Declaration of minimum number of keys allowed depending on leaf or non-leaf node
-    unsigned int minKeys = 0;
-    if (header.isLeaf) {
-        minKeys = (maxKeys+1)/2;
-    } else {
-        minKeys = maxKeys/2;
-    }
 
     // Perform deletion of any overflow nodes first, if they exist
     if (ptrArr[i].recordID == -1) { // RecordID of -1 indicates that there is an overflow node
-        void* overflowNode = ptrArr[i].blockAddress;
-        pointerBlockPair* ptrArr;
-        void* nextOverflow;
-        while (overflowNode != nullptr) {
+        int overflowId = ptrArr[i].blockId;
+        while (overflowId != -1) {
             numOverflowNodesDeleted++;
-            ptrArr = (pointerBlockPair*) (((NodeHeader*) overflowNode ) + 1 );
-            nextOverflow = ptrArr[maxKeys].blockAddress; // hold pointer nextOverflow before we free current overflow block
-            free(overflowNode);
+            pointerBlockPair* ptrArrO = (pointerBlockPair*) (((NodeHeader*) pinNode(overflowId) ) + 1 );
+            int nextOverflowId = ptrArrO[maxKeys].blockId; // hold id of nextOverflow before we free current overflow block
+            unpinNode(overflowId, false);
+            releaseNode(overflowId);
             numOverflowNodes--;
-            overflowNode = nextOverflow; //Proceed to delete and free next overflowNode
+            overflowId = nextOverflowId; //Proceed to delete and free next overflowNode
         }
     }
     // Perform deletion of key from node
+    shiftElementsForward(numVotesArr, ptrArr, i, true);
     (*numKeys)--;
-    if (i != maxKeys-1) { //If element to remove is not the last element
-        shiftElementsForward(numVotesArr, ptrArr, i, header.isLeaf);
-    }
 
-    void* parentNode = ((NodeHeader*)nodeToDeleteFrom)->pointerToParent.blockAddress;
-    int numKeysInParent = *(unsigned int*) parentNode;
-    pointerBlockPair* ptrArrParent = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
-    unsigned int* numVotesArrParent = (unsigned int*) (ptrArrParent + maxKeys + 1);
-    
-    // Check if the key to be deleted appears in any of its ancestors and find the node it is in
-    // This will only occur if the key we are deleting is the smallest key in its index node
-    if (i == 0) {
-        void* recursiveParent = parentNode;
+    // If the deleted key was the smallest key of the leaf, it may also be a key of an ancestor, which is replaced by the new smallest key
+    if (i == 0 && *numKeys > 0) {
+        int recursiveParent = ((NodeHeader*)node)->pointerToParent.blockId;
         bool foundFlag = false;
-        while (recursiveParent != nullptr){
-            int numKeysInRParent = *(unsigned int*) recursiveParent;
-            pointerBlockPair* ptrArrRParent = (pointerBlockPair*) (((NodeHeader*) recursiveParent ) + 1 );
+        while (recursiveParent != -1 && !foundFlag){
+            void* parentNode = latchNode(recursiveParent);
+            unsigned int numKeysInRParent = *(unsigned int*) parentNode;
+            pointerBlockPair* ptrArrRParent = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
             unsigned int* numVotesArrRParent = (unsigned int*) (ptrArrRParent + maxKeys + 1);
-            for (int k = 0; k < numKeysInParent; k++){
+            for (unsigned int k = 0; k < numKeysInRParent; k++){
                 if (numVotesArrRParent[k] == numVotes) {
                     numVotesArrRParent[k] = numVotesArr[0];
                     foundFlag = true;
                     break;
                 }
             }
-            if (foundFlag) break;
-            else recursiveParent = ((NodeHeader*)recursiveParent)->pointerToParent.blockAddress;
+            recursiveParent = ((NodeHeader*)parentNode)->pointerToParent.blockId;
         } 
     }
-    
-    // If the number of keys remaining is less than minimum keys allowed, borrowing/merging needs to be performed
-    if (*numKeys < minKeys){  
-        for (int ourPosInParent = 0; ourPosInParent <= numKeysInParent; ourPosInParent++){
-            //find number of keys in sibling node
-            //check if number- 1 is less than minkeys
-            if(ptrArrParent[ourPosInParent].blockAddress == nodeToDeleteFrom){ // find our position in parentNode so we can identify our siblings
-                void* sibling = nullptr;
-                unsigned int* siblingNumKeys;
-                bool borrowFromLeft;
-                NodeHeader siblingHeader;
-
-                // If left sibling exists, check if a key can be borrowed from left sibling
-                if (ourPosInParent != 0) {                
-                    sibling = ptrArrParent[ourPosInParent-1].blockAddress;
-                    siblingNumKeys = (unsigned int*) sibling;
-                    siblingHeader = *(NodeHeader*) sibling;
-                    if (*siblingNumKeys - 1 < minKeys){ // Not possible to borrow from left sibling
-                        sibling = nullptr;
-                    } else { // borrow from left sibling, dont bother checking with right sibling
-                        borrowFromLeft = true;
-                    }
-                }
 
-                // If key cannot be borrowed from left sibiling/left sibling does not exist, check right sibling
-                if (sibling == nullptr && ourPosInParent != numKeysInParent) { 
-                    sibling = ptrArrParent[ourPosInParent+1].blockAddress;
-                    siblingNumKeys = (unsigned int*) sibling;
-                    siblingHeader = *(NodeHeader*) sibling;
-                    if (*siblingNumKeys - 1 < minKeys){ // Not possible to borrow from right sibling
-                        sibling = nullptr;
-                    } else { // borrow from right sibling
-                        borrowFromLeft = false;
-                    }
-                }
-                
-                // Perform borrowing if there exists a sibling that allows for borrowing
-                if (sibling != nullptr){
-                    pointerBlockPair* ptrArrSibling = (pointerBlockPair*) (((NodeHeader*) sibling ) + 1 );
-                    unsigned int* numVotesArrSibling = (unsigned int*) (ptrArrSibling + maxKeys + 1);
-                    if (borrowFromLeft){
-
-                        // Borrow last key from left sibling
-                        // Shift all elements in nodeToDeleteFrom to the right to make space for the new key
-                        shiftElementsBack(numVotesArr, ptrArr, 0, siblingHeader.isLeaf);
-                        numVotesArr[0] = numVotesArrSibling[(*siblingNumKeys)-1]; // Borrowing of key
-                        ptrArr[0] = ptrArrSibling[(*siblingNumKeys)-1];
-                        (*siblingNumKeys)--;
-                        (*numKeys)++;
-
-                        //Update the index in parent node that leads to this node
-                        numVotesArrParent[ourPosInParent-1] = numVotesArr[0]; 
-                    } else {
-
-                        // Borrow first key from right sibling
-                        numVotesArr[*numKeys] = numVotesArrSibling[0]; // Borrowing of key
-                        ptrArr[*numKeys] = ptrArrSibling[0];
-                        (*numKeys)++;
-
-                        // Shift all elements in right sibling to fill up space due to key borrowed
-                        shiftElementsForward(numVotesArrSibling, ptrArrSibling, 0, siblingHeader.isLeaf);
-
-                        (*siblingNumKeys)--;
-
-                        //update the index in parent node that leads to right sibling
-                        numVotesArrParent[ourPosInParent] = numVotesArrSibling[0]; 
-                    }
+    rebalanceNode(nodeToDeleteFrom);
+}
 
-                // Borrowing from sibling, cannot be performed, to merge with sibling
-                } else { 
-                    if (ourPosInParent != 0){ // if not leftmost node, merge with left sibling
-                        mergeNodes(ptrArrParent[ourPosInParent-1].blockAddress, nodeToDeleteFrom);
-                    } else { // if leftmost node, merge with right sibling
-                        mergeNodes(nodeToDeleteFrom, ptrArrParent[1].blockAddress);
-                    }                    
-                }
 
-                break;
+// Restores the minimum number of keys of a node that a key was removed from, by borrowing a key from a sibling
+// or else merging with one, a merge removes a key from the parent node which may then have to be rebalanced too
+// The root has no minimum, but a non-leaf root left with a single child is replaced by that child
+// Siblings are latched before their number of keys is read, so that no insertion can change it in between
+void BPlusTree::rebalanceNode(int nodeId) {
+
+    void* node = latchNode(nodeId);
+    unsigned int* numKeys = (unsigned int*)node;
+    bool isLeaf = ((NodeHeader*) node)->isLeaf;
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
+    unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
+
+    if (nodeId == root) {
+        if (!isLeaf && *numKeys == 0) {
+            int newRoot = ptrArr[0].blockId;
+            setParent(newRoot, -1);
+            __atomic_store_n(&root, newRoot, __ATOMIC_RELEASE);
+            releaseNode(nodeId);
+            numNodes--;
+            numNodesDeleted++;
+            height--;
+        }
+        return;
+    }
+
+    // Declaration of minimum number of keys allowed depending on leaf or non-leaf node
+    unsigned int minKeys = isLeaf ? (maxKeys+1)/2 : maxKeys/2;
+    if (*numKeys >= minKeys) return;
+
+    int parentId = ((NodeHeader*)node)->pointerToParent.blockId;
+    void* parentNode = latchNode(parentId);
+    unsigned int numKeysInParent = *(unsigned int*) parentNode;
+    pointerBlockPair* ptrArrParent = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
+    unsigned int* numVotesArrParent = (unsigned int*) (ptrArrParent + maxKeys + 1);
+
+    // find our position in parentNode so we can identify our siblings
+    unsigned int ourPosInParent = 0;
+    while (ptrArrParent[ourPosInParent].blockId != nodeId) {
+        ourPosInParent++;
+    }
+
+    // Borrow the last key of the left sibling
+    int leftSiblingId = ourPosInParent != 0 ? ptrArrParent[ourPosInParent-1].blockId : -1;
+    void* leftSibling = leftSiblingId != -1 ? latchNode(leftSiblingId) : nullptr;
+    if (leftSibling != nullptr && *(unsigned int*) leftSibling > minKeys) {
+        unsigned int* numKeysL = (unsigned int*) leftSibling;
+        pointerBlockPair* ptrArrL = (pointerBlockPair*) (((NodeHeader*) leftSibling ) + 1 );
+        unsigned int* numVotesArrL = (unsigned int*) (ptrArrL + maxKeys + 1);
+        if (isLeaf) {
+            shiftElementsBack(numVotesArr, ptrArr, 0, true);
+            numVotesArr[0] = numVotesArrL[*numKeysL-1];
+            ptrArr[0] = ptrArrL[*numKeysL-1];
+            numVotesArrParent[ourPosInParent-1] = numVotesArr[0]; //Update the key in parent node that leads to this node
+        } else {
+            // The key in the parent comes down in front of this node's keys, and the left sibling's last key goes up in its place
+            for (unsigned int j = *numKeys; j > 0; j--) {
+                numVotesArr[j] = numVotesArr[j-1];
+            }
+            for (unsigned int j = *numKeys+1; j > 0; j--) {
+                ptrArr[j] = ptrArr[j-1];
             }
+            numVotesArr[0] = numVotesArrParent[ourPosInParent-1];
+            ptrArr[0] = ptrArrL[*numKeysL];
+            setParent(ptrArr[0].blockId, nodeId);
+            numVotesArrParent[ourPosInParent-1] = numVotesArrL[*numKeysL-1];
         }
-    } 
+        (*numKeysL)--;
+        (*numKeys)++;
+        return;
+    }
 
-    // If deleting root node, the current node becomes the new root node
-    if (nodeToDeleteFrom == root && *numKeys == 1){
-        free(root);
-        numNodes--;
-        numNodesDeleted++;
-        root = ptrArr[0].blockAddress;
+    // Borrow the first key of the right sibling
+    int rightSiblingId = ourPosInParent != numKeysInParent ? ptrArrParent[ourPosInParent+1].blockId : -1;
+    void* rightSibling = rightSiblingId != -1 ? latchNode(rightSiblingId) : nullptr;
+    if (rightSibling != nullptr && *(unsigned int*) rightSibling > minKeys) {
+        unsigned int* numKeysR = (unsigned int*) rightSibling;
+        pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) rightSibling ) + 1 );
+        unsigned int* numVotesArrR = (unsigned int*) (ptrArrR + maxKeys + 1);
+        if (isLeaf) {
+            numVotesArr[*numKeys] = numVotesArrR[0];
+            ptrArr[*numKeys] = ptrArrR[0];
+            shiftElementsForward(numVotesArrR, ptrArrR, 0, true);
+            numVotesArrParent[ourPosInParent] = numVotesArrR[0]; //Update the key in parent node that leads to right sibling
+        } else {
+            // The key in the parent comes down after this node's keys, and the right sibling's first key goes up in its place
+            numVotesArr[*numKeys] = numVotesArrParent[ourPosInParent];
+            ptrArr[*numKeys+1] = ptrArrR[0];
+            setParent(ptrArr[*numKeys+1].blockId, nodeId);
+            numVotesArrParent[ourPosInParent] = numVotesArrR[0];
+            for (unsigned int j = 0; j < *numKeysR; j++) {
+                if (j < *numKeysR-1) numVotesArrR[j] = numVotesArrR[j+1];
+                ptrArrR[j] = ptrArrR[j+1];
+            }
+        }
+        (*numKeysR)--;
+        (*numKeys)++;
+        return;
+    }
+
+    // Borrowing from sibling cannot be performed, merge with the left sibling, or with the right one for the leftmost node
+    if (leftSibling != nullptr) {
+        mergeNodes(leftSiblingId, nodeId, parentId, ourPosInParent-1);
+    } else {
+        mergeNodes(nodeId, rightSiblingId, parentId, ourPosInParent);
     }
 }
 
 
-// Merges two nodes if number of keys is insufficient from the B+ Tree
-// Merging occurs by keeping the left node, and deleting the right node
-// Is called by deleteKey() if deletion results in nodes with insufficient keys
-void BPlusTree::mergeNodes(void* leftNode, void* rightNode) {
+// Merges two neighbouring nodes whose keys fit in one node, by keeping the left node and releasing the right node
+// separatorIndex is the position of the key in parentNode between the two nodes, for non-leaf nodes it comes down between their keys
+// The key and the pointer to the right node are removed from parentNode, which is rebalanced in turn
+// Is called by rebalanceNode() if no sibling has a key to spare
+void BPlusTree::mergeNodes(int leftNode, int rightNode, int parentNode, unsigned int separatorIndex) {
+
+    void* left = latchNode(leftNode);
+    void* right = latchNode(rightNode);
+    void* parent = latchNode(parentNode);
 
-    pointerBlockPair* ptrArrL = (pointerBlockPair*) (((NodeHeader*) leftNode ) + 1 );
+    pointerBlockPair* ptrArrL = (pointerBlockPair*) (((NodeHeader*) left ) + 1 );
     unsigned int* numVotesArrL = (unsigned int*) (ptrArrL + maxKeys + 1);
 
-    pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) rightNode ) + 1 );
+    pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) right ) + 1 );
     unsigned int* numVotesArrR = (unsigned int*) (ptrArrR + maxKeys + 1);
 
-    unsigned int smallestRight = numVotesArrR[0];
-    unsigned int* numKeysL = (unsigned int*)leftNode;
-    unsigned int* numKeysR = (unsigned int*)rightNode;
+    unsigned int* numKeysL = (unsigned int*)left;
+    unsigned int* numKeysR = (unsigned int*)right;
 
-    // For each item in the right node, append to the left node
-    for (int i=0; i<*numKeysR; i++) {
-        numVotesArrL[*numKeysL+i] = numVotesArrR[i];
-        ptrArrL[*numKeysL+i] = ptrArrR[i];
-    }
-    *numKeysL += *numKeysR;
-    
-    // For leaf nodes, the original left node should now point to the node pointed to by the original right node
-    NodeHeader header = *(NodeHeader*) leftNode;
-    if (header.isLeaf) {
+    pointerBlockPair* ptrArrParent = (pointerBlockPair*) (((NodeHeader*) parent ) + 1 );
+    unsigned int* numVotesArrParent = (unsigned int*) (ptrArrParent + maxKeys + 1);
+
+    if (((NodeHeader*) left)->isLeaf) {
+        // For each item in the right node, append to the left node
+        for (unsigned int i = 0; i < *numKeysR; i++) {
+            numVotesArrL[*numKeysL+i] = numVotesArrR[i];
+            ptrArrL[*numKeysL+i] = ptrArrR[i];
+        }
+        *numKeysL += *numKeysR;
+        // The original left node should now point to the node pointed to by the original right node
         ptrArrL[maxKeys] = ptrArrR[maxKeys];
+    } else {
+        // The key between the two nodes comes down from the parent, followed by the keys and pointers of the right node
+        numVotesArrL[*numKeysL] = numVotesArrParent[separatorIndex];
+        for (unsigned int i = 0; i < *numKeysR; i++) {
+            numVotesArrL[*numKeysL+1+i] = numVotesArrR[i];
+        }
+        for (unsigned int i = 0; i <= *numKeysR; i++) {
+            ptrArrL[*numKeysL+1+i] = ptrArrR[i];
+            setParent(ptrArrR[i].blockId, leftNode);
+        }
+        *numKeysL += *numKeysR + 1;
     }
 
-    // Retrieve parent node for deletion of key
-    void* parentNode = ((NodeHeader*)leftNode)->pointerToParent.blockAddress;
-
-    free(rightNode);
+    releaseNode(rightNode);
     numNodes--;
     numNodesDeleted++;
 
-    //Parent node that points to the original left and right node will have one less key
-    //Key to be removed from parent node is always first key of original right node
-    //Smallest right is passed in with the parent node
-    deleteKey(smallestRight, parentNode);
+    // Parent node that points to the original left and right node will have one less key and one less pointer
+    shiftElementsForward(numVotesArrParent, ptrArrParent, separatorIndex, false);
+    (*(unsigned int*) parent)--;
+    rebalanceNode(parentNode);
 }
 
 
@@ -506,21 +1124,24 @@ void BPlusTree::mergeNodes(void* leftNode, void* rightNode) {
 // New node will be to the right of the original node
 // Original node is now the left node
 // Calls updateParentNodeAfterSplit() to update keys in parent node
-void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, void* nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr) {
+void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, int nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr) {
 
-    void* leftNode = nodeToSplit;
-    void* rightNode = getNewNode(true, false); // Create new right node
+    void* leftNode = latchNode(nodeToSplit);
+    int rightNodeId;
+    getNewNode(true, false, rightNodeId); // Create new right node
+    void* rightNode = latchNode(rightNodeId); // readers must not see it before it is linked in and filled
+    unpinNode(rightNodeId, true);
 
     list<pointerBlockPair> tempPtrList;
     list<unsigned int> tempNumVotesList;
     unsigned int numLeftKeys = ceil((maxKeys+1)/2.0);
     unsigned int numRightKeys = floor((maxKeys+1)/2.0);
-    void* parentNode = ((NodeHeader*)nodeToSplit)->pointerToParent.blockAddress;
+    int parentNode = ((NodeHeader*)leftNode)->pointerToParent.blockId;
 
     // Copy existing keys into a temp list, and add in new key in correct position
     bool newKeyInserted = false;
     
-    for (int i = 0; i < maxKeys; i++) {
+    for (unsigned int i = 0; i < maxKeys; i++) {
         if (!newKeyInserted && numVotes < numVotesArr[i]){
             tempNumVotesList.push_back(numVotes);
             tempPtrList.push_back(record);
@@ -538,7 +1159,7 @@ void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, vo
     unsigned int* numVotesArrR = (unsigned int*) (ptrArrR + maxKeys + 1);
     
     // Filling in keys for new left node
-    for (int i = 0; i < numLeftKeys; i++) {
+    for (unsigned int i = 0; i < numLeftKeys; i++) {
         numVotesArr[i] = tempNumVotesList.front();
         ptrArr[i] = tempPtrList.front();
         tempNumVotesList.pop_front();
@@ -547,7 +1168,7 @@ void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, vo
     *((unsigned int*) leftNode) = numLeftKeys;
     
     // Filling in keys for new right node
-    for (int i = 0; i < numRightKeys; i ++) {
+    for (unsigned int i = 0; i < numRightKeys; i ++) {
         numVotesArrR[i] = tempNumVotesList.front();
         ptrArrR[i] = tempPtrList.front();
         tempNumVotesList.pop_front();
@@ -558,10 +1179,10 @@ void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, vo
     // Linking of leaf nodes
     // Original right node should now point to the node pointed to by the original left node
     // Left node should now point to the newly created right node
-    ptrArrR[maxKeys].blockAddress = ptrArr[maxKeys].blockAddress;
-    ptrArr[maxKeys].blockAddress = rightNode; 
+    ptrArrR[maxKeys].blockId = ptrArr[maxKeys].blockId;
+    ptrArr[maxKeys].blockId = rightNodeId; 
 
-    updateParentNodeAfterSplit(parentNode, rightNode, numVotesArrR[0]);
+    updateParentNodeAfterSplit(parentNode, rightNodeId, numVotesArrR[0]);
     
     return;
 }
@@ -571,19 +1192,22 @@ void BPlusTree::splitLeafNode(unsigned int numVotes, pointerBlockPair record, vo
 // New node will be to the right of the original node
 // Original node is now the left node
 // Calls updateParentNodeAfterSplit() to update keys in parent node
-void BPlusTree::splitNonLeafNode(unsigned int numVotes, pointerBlockPair record, void* nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr) {
+void BPlusTree::splitNonLeafNode(unsigned int numVotes, pointerBlockPair record, int nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr) {
 
-    void* leftNode = nodeToSplit;
-    void* rightNode = getNewNode(false, false); // Create new right node
+    void* leftNode = latchNode(nodeToSplit);
+    int rightNodeId;
+    getNewNode(false, false, rightNodeId); // Create new right node
+    void* rightNode = latchNode(rightNodeId);
+    unpinNode(rightNodeId, true);
 
     list<pointerBlockPair> tempPtrList;
     list<unsigned int> tempNumVotesList;
     unsigned int numLeftKeys = ceil(maxKeys/2.0); 
     unsigned int numRightKeys = floor(maxKeys/2.0);
-    void* parentNode = ((NodeHeader*)nodeToSplit)->pointerToParent.blockAddress;
+    int parentNode = ((NodeHeader*)leftNode)->pointerToParent.blockId;
 
     // Copy existing keys into a temp list
-    for (int i = 0; i < maxKeys; i++) {
+    for (unsigned int i = 0; i < maxKeys; i++) {
         tempNumVotesList.push_back(numVotesArr[i]);
         tempPtrList.push_back(ptrArr[i]);
     }
@@ -612,17 +1236,17 @@ void BPlusTree::splitNonLeafNode(unsigned int numVotes, pointerBlockPair record,
     unsigned int* numVotesArrR = (unsigned int*) (ptrArrR + maxKeys + 1);
     
     // Filling in keys for new left node
-    int i;
+    unsigned int i;
     for (i = 0; i < numLeftKeys; i++) {
         numVotesArr[i] = tempNumVotesList.front();
         ptrArr[i] = tempPtrList.front();
-        ((NodeHeader*) ptrArr[i].blockAddress)->pointerToParent.blockAddress = leftNode; // update all children to point to leftNode as new parent
+        setParent(ptrArr[i].blockId, nodeToSplit); // update all children to point to leftNode as new parent
         tempNumVotesList.pop_front();
         tempPtrList.pop_front();
     }
     ptrArr[i] = tempPtrList.front(); // node needs 1 more ptr than key
     tempPtrList.pop_front(); //Pop the pointer after assigning it
-    ((NodeHeader*) ptrArr[numLeftKeys].blockAddress)->pointerToParent.blockAddress = leftNode; // update last children to point to leftNode as new parent
+    setParent(ptrArr[numLeftKeys].blockId, nodeToSplit); // update last children to point to leftNode as new parent
     *((unsigned int*) leftNode) = numLeftKeys; //Update the number of keys for this left node
 
 
@@ -635,16 +1259,16 @@ void BPlusTree::splitNonLeafNode(unsigned int numVotes, pointerBlockPair record,
     for (i = 0; i < numRightKeys; i++) {
         numVotesArrR[i] = tempNumVotesList.front();
         ptrArrR[i] = tempPtrList.front();
-        ((NodeHeader*) ptrArrR[i].blockAddress)->pointerToParent.blockAddress = rightNode; // update all children of right node to point to itself as new parent
+        setParent(ptrArrR[i].blockId, rightNodeId); // update all children of right node to point to itself as new parent
         tempNumVotesList.pop_front();
         tempPtrList.pop_front();
     }    
     ptrArrR[numRightKeys] = tempPtrList.front(); // For non-leaf nodes, n keys requires (n+1) pointers, pop one more pointer
     tempPtrList.pop_front();
-    ((NodeHeader*) ptrArrR[numRightKeys].blockAddress)->pointerToParent.blockAddress = rightNode; // update last children to point to itself as new parent
+    setParent(ptrArrR[numRightKeys].blockId, rightNodeId); // update last children to point to itself as new parent
     *((unsigned int*) rightNode) = numRightKeys; // Update the number of keys for this right node
 
-    updateParentNodeAfterSplit(parentNode, rightNode, newParentKey);
+    updateParentNodeAfterSplit(parentNode, rightNodeId, newParentKey);
 
     return;
 }
@@ -653,42 +1277,47 @@ void BPlusTree::splitNonLeafNode(unsigned int numVotes, pointerBlockPair record,
 // Updates parent node after a split has been occured
 // Is called by either splitLeafNode() or splitNonLeafNode()
 // Can also call splitNonLeafNode() if the parent node ends up having insufficient number of keys
-void BPlusTree::updateParentNodeAfterSplit(void* parentNode, void* rightNode, unsigned int newKey) { 
+void BPlusTree::updateParentNodeAfterSplit(int parentNode, int rightNode, unsigned int newKey) { 
 
     //If root node is the node being split, we need to create a new root 
-    if (parentNode == nullptr) {
-        void* newRootNode = getNewNode(false, false); // create a parent node (root)
+    if (parentNode == -1) {
+        int newRootNode;
+        getNewNode(false, false, newRootNode); // create a parent node (root)
+        void* newRoot = latchNode(newRootNode);
+        unpinNode(newRootNode, true);
 
-        pointerBlockPair* ptrArrNew = (pointerBlockPair*) (((NodeHeader*) newRootNode ) + 1 );
+        pointerBlockPair* ptrArrNew = (pointerBlockPair*) (((NodeHeader*) newRoot ) + 1 );
         unsigned int* numVotesArrNew = (unsigned int*) (ptrArrNew + maxKeys + 1);
         
-        ptrArrNew[0].blockAddress = root; // old root node became the left node
-        ptrArrNew[1].blockAddress = rightNode; 
+        ptrArrNew[0].blockId = root; // old root node became the left node
+        ptrArrNew[1].blockId = rightNode; 
         numVotesArrNew[0] = newKey; // only key in new root node is the smallest key of the right subtree
-        (*((unsigned int*) newRootNode))++;
+        (*((unsigned int*) newRoot))++;
 
         // update parent of the new child nodes
-        ((NodeHeader*) root)->pointerToParent.blockAddress = newRootNode; // this is the left node
-        ((NodeHeader*) rightNode)->pointerToParent.blockAddress = newRootNode;
+        void* oldRoot = latchNode(root); // this is the left node
+        ((NodeHeader*) oldRoot)->pointerToParent.blockId = newRootNode;
+        ((NodeHeader*) latchNode(rightNode))->pointerToParent.blockId = newRootNode;
 
-        if (((NodeHeader*) root)->isLeaf) { // left node (old root) needs to link to (new) right node
-            pointerBlockPair* ptrArrRoot = (pointerBlockPair*) (((NodeHeader*) root) + 1 );
-            ptrArrRoot[maxKeys].blockAddress = rightNode; // link leaf nodes together
+        if (((NodeHeader*) oldRoot)->isLeaf) { // left node (old root) needs to link to (new) right node
+            pointerBlockPair* ptrArrRoot = (pointerBlockPair*) (((NodeHeader*) oldRoot) + 1 );
+            ptrArrRoot[maxKeys].blockId = rightNode; // link leaf nodes together
         } 
 
-        root = newRootNode; //Reinitialise new root
+        __atomic_store_n(&root, newRootNode, __ATOMIC_RELEASE); //Reinitialise new root
         height++; //Increment the variable storing the height of B++ tree
         
     } else { //there exists a parent node already
-        int numKeys = *(unsigned int*) parentNode;
+        void* parent = latchNode(parentNode);
+        int numKeys = *(unsigned int*) parent;
         
         //Initialise ptrArr and numVotesArr to access pointer and key arrays
-        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) parent ) + 1 );
         unsigned int* numVotesArr = (unsigned int*) (ptrArr + maxKeys + 1);
         
         //parent node need to be split
-        if (numKeys == maxKeys) {      
-            pointerBlockPair addrToRightNode = {rightNode, -1};
+        if (numKeys == (int) maxKeys) {      
+            pointerBlockPair addrToRightNode = {rightNode, -1, 0, RATING_NOT_INCLUDED};
             splitNonLeafNode(newKey, addrToRightNode, parentNode, ptrArr, numVotesArr);
         } else { // parent node don't need to split
             int i;
@@ -703,27 +1332,36 @@ void BPlusTree::updateParentNodeAfterSplit(void* parentNode, void* rightNode, un
                 }
             }
             numVotesArr[i] = newKey; //Insert the index value at specified location // replaced smallestKey with newKey
-            ptrArr[i+1].blockAddress = rightNode; //Insert the pointer to the record in the disk at specified location
-            (*(unsigned int*)parentNode)++; //Increment numRecords
-            ((NodeHeader*) rightNode)->pointerToParent.blockAddress = parentNode; // right node's parent is the same as left node
+            ptrArr[i+1].blockId = rightNode; //Insert the pointer to the record in the disk at specified location
+            (*(unsigned int*)parent)++; //Increment numRecords
+            ((NodeHeader*) latchNode(rightNode))->pointerToParent.blockId = parentNode; // right node's parent is the same as left node
         } 
     }
     
 } 
 
 
+// Sets the parent of a node that moved to another parent, e.g. the children of a split or merged node
+// The node is not latched, since readers never follow the pointer to the parent
+void BPlusTree::setParent(int nodeId, int parentId) {
+    void* node = pinNode(nodeId);
+    ((NodeHeader*) node)->pointerToParent.blockId = parentId;
+    unpinNode(nodeId, true);
+}
+
+
 // Shift all keys forward by one space
 // Called by deleteKey() when borrowing elements
 // Also called by deleteKey() when deleting the first key from the node
 void BPlusTree::shiftElementsForward(unsigned int* numVotesArr, pointerBlockPair* ptrArr, int start, bool isLeaf) {
 
     if (isLeaf) {
-        for (int j = start; j < maxKeys-1; j++) { // stop shifting at i=maxKeys-2 since numVotesArr[maxKeys-1] is the last key
+        for (int j = start; j < (int) maxKeys-1; j++) { // stop shifting at i=maxKeys-2 since numVotesArr[maxKeys-1] is the last key
             numVotesArr[j] = numVotesArr[j+1]; 
             ptrArr[j] = ptrArr[j+1]; 
         } 
     } else {
-        for (int j = start; j < maxKeys-1; j++) { 
+        for (int j = start; j < (int) maxKeys-1; j++) { 
             numVotesArr[j] = numVotesArr[j+1];
             ptrArr[j+1] = ptrArr[j+2]; //For non-leaf node, the j-th key correspond to the (j+1)th pointer
         } 
@@ -753,14 +1391,15 @@ void BPlusTree::shiftElementsBack(unsigned int* numVotesArr, pointerBlockPair* p
 // Shows the keys currently in each node
 void BPlusTree::printTree(ofstream &output) {
 
-    list<void*> queue;
+    list<int> queue;
     int nodesInCurLevel = 1;
     int nodesInNextLevel = 0;
     int nodesPrinted = 0;
     queue.push_back(root);
     
     while (queue.size() != 0) {
-        void* currNode = queue.front();
+        int currNodeId = queue.front();
+        void* currNode = pinNode(currNodeId);
         queue.pop_front();
 
         // print currNode
@@ -781,9 +1420,10 @@ void BPlusTree::printTree(ofstream &output) {
         // add child nodes
         if (!(header->isLeaf)) {            
             for (unsigned int i=0; i<numKeys+1; i++) {
-                queue.push_back(ptrArr[i].blockAddress);
+                queue.push_back(ptrArr[i].blockId);
             }
         }
+        unpinNode(currNodeId, false);
 
     }
 
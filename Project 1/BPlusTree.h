@@ -1,19 +1,46 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
 #include <cstdlib>
 #include <list>
 #include "structures.h"
+#include "DiskSimulator.h"
+#include "BufferPool.h"
 #include <iostream>
 #include <math.h>
 #include <fstream>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <cstdint>
 
 using namespace std;
 
 class BPlusTree
 {
     public:
-    void *root;
+    int root;           // block id of the root node
     unsigned int height;
     unsigned int maxKeys;
     unsigned int sizeOfNode;
+    DiskSimulator* disk;
+    BufferPool* bufferPool; // nodes are read and written through the buffer pool, like the data blocks
+    int segmentId;      // disk segment whose extents hold the nodes, one node per block
+    int headerId;       // block of the segment holding the bPlusTreeHeader, before every node
+    int freeNodes;      // nodes released by deletions, kept for reuse by getNewNode(), -1 if there are none
+    bool isLoaded;      // true if the tree was found on a reopened disk
+
+    // Concurrent access: readers never latch, they check the version of every node they read and start again if it changed
+    // Insertions that fit in their leaf latch only the leaf, structure changes (splits, deletions, bulk loads)
+    // are made one at a time under structureLatch and latch the nodes they change
+    // A node is pinned in the buffer pool while it is read or latched, its version is kept in its frame
+    mutex structureLatch;
+    mutex allocationLatch;          // getNewNode() and the free list
+    vector<pair<int, void*>> latchedNodes; // nodes latched by the structure change in progress, with their frames
+    vector<int> releasedNodes;      // nodes released by the structure change in progress, freed with its latches
+
+    // Number of keys findRecordsBatch() walks down the tree together
+    static constexpr int BATCH_GROUP_SIZE = 16;
 
     //For Experiments
     unsigned int numNodes;
@@ -24,27 +51,59 @@ class BPlusTree
     int numOverflowNodesDeleted;
 
     //Initialisation and setting functions
-    BPlusTree(unsigned int sizeOfNode);
-    void* getNewNode(bool isLeaf, bool isOverflow);
+    BPlusTree(unsigned int sizeOfNode, DiskSimulator* disk, BufferPool* bufferPool, int segmentId);
+    ~BPlusTree();
+    void* pinNode(int nodeId);
+    void unpinNode(int nodeId, bool isDirty);
+    void* getNewNode(bool isLeaf, bool isOverflow, int &nodeId);
+    void releaseNode(int nodeId);
+    void prefetchNode(int nodeId);
 
     //Retrieval functions
     list<pointerBlockPair> findRecord(unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output);
-    void* findNode(unsigned int numVotes, void* node, unsigned int currentHeight, ofstream &output, bool willPrint);
+    int findLeaf(unsigned int numVotes);
+    static unsigned int upperBound(const unsigned int* numVotesArr, unsigned int numKeys, unsigned int numVotes);
+    static unsigned int lowerBound(const unsigned int* numVotesArr, unsigned int numKeys, unsigned int numVotes);
+    void findLeaves(const unsigned int* numVotes, int numKeys, int* leaves);
+    vector<vector<pointerBlockPair>> findRecordsBatch(const vector<unsigned int> &numVotes);
+    void findNeighbours(unsigned int numVotes, pointerBlockPair &before, pointerBlockPair &after);
+    pointerBlockPair entryOfKey(pointerBlockPair leafPointer, bool isLast);
 
     //Functions for inserting a record
     void insertRecord(unsigned int numVotes, pointerBlockPair record);
-    void splitLeafNode(unsigned int numVotes, pointerBlockPair record, void* nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr);
-    void splitNonLeafNode(unsigned int numVotes, pointerBlockPair record, void* nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr);
-    void updateParentNodeAfterSplit(void* parentNode, void* rightNode, unsigned int newParentKey);
+    void insertIntoLeaf(int nodeId, void* nodeToInsertAt, unsigned int numVotes, pointerBlockPair record);
+    void splitLeafNode(unsigned int numVotes, pointerBlockPair record, int nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr);
+    void splitNonLeafNode(unsigned int numVotes, pointerBlockPair record, int nodeToSplit, pointerBlockPair* ptrArr, unsigned int* numVotesArr);
+    void updateParentNodeAfterSplit(int parentNode, int rightNode, unsigned int newParentKey);
+    void setParent(int nodeId, int parentId);
+
+    //Functions for building the tree from many records at once
+    void bulkLoad(vector<pair<unsigned int, pointerBlockPair>> &records, float fillFactor);
+    vector<unsigned int> packedNodeSizes(size_t numItems, unsigned int itemsPerNode, unsigned int minItems);
 
     //Functions for deleting a record
-    void deleteKey(unsigned int numVotes, void* nodeToDeleteFrom);
-    void mergeNodes(void* leftNode, void* rightNode);
+    void removeKey(unsigned int numVotes);
+    void deleteKey(unsigned int numVotes, int nodeToDeleteFrom);
+    void rebalanceNode(int node);
+    void mergeNodes(int leftNode, int rightNode, int parentNode, unsigned int separatorIndex);
     void shiftElementsForward(unsigned int* numVotesArr, pointerBlockPair* ptrArr, int start, bool isLeaf);
     void shiftElementsBack(unsigned int* numVotesArr, pointerBlockPair* ptrArr, int end, bool isLeaf);
 
+    //Functions for concurrent access
+    static bool readLock(void* node, uint64_t &version);
+    static bool validate(void* node, uint64_t version);
+    static bool upgradeLock(void* node, uint64_t version);
+    static void writeLock(void* node);
+    static void writeUnlock(void* node, bool isObsolete);
+    void* latchNode(int nodeId);
+    void releaseLatches();
+    bool findLeafOptimistic(unsigned int numVotes, int &leafId, void* &leaf, uint64_t &version);
+    void findRange(unsigned int numVotesStart, unsigned int numVotesEnd, vector<pointerBlockPair> &entries);
+
     //Functions for Experiments/Visualization
     int printIndexBlock(void* node, ofstream &output);
     void printRoot(ofstream &output);
     void printTree(ofstream &output);
-};
\ No newline at end of file
+};
+
+#endif
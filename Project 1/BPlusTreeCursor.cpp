@@ -0,0 +1,116 @@
+#include "BPlusTreeCursor.h"
+
+BPlusTreeCursor::BPlusTreeCursor(BPlusTree* tree)
+{
+    this->tree = tree;
+    numVotesEnd = 0;
+    leafNode = -1;
+    index = 0;
+    overflowNode = -1;
+    overflowIndex = 0;
+    numIndexAccessed = 0;
+    numOverflowNodesAccessed = 0;
+}
+
+void BPlusTreeCursor::seek(unsigned int numVotesStart, unsigned int numVotesEnd)
+{
+    this->numVotesEnd = numVotesEnd;
+    numIndexAccessed = tree->height + 1; // one node per level on the way down to the leaf
+    numOverflowNodesAccessed = 0;
+    overflowNode = -1;
+    overflowIndex = 0;
+
+    // Start from the first key >= numVotesStart, nextN() moves on to the next leaf if every key of this one is smaller
+    leafNode = tree->findLeaf(numVotesStart);
+    void* leaf = tree->pinNode(leafNode);
+    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+    unsigned int* numVotesArr = (unsigned int*) (ptrArr + tree->maxKeys + 1);
+    index = BPlusTree::lowerBound(numVotesArr, *(unsigned int*)leaf, numVotesStart);
+    tree->prefetchNode(ptrArr[tree->maxKeys].blockId);
+    tree->unpinNode(leafNode, false);
+}
+
+bool BPlusTreeCursor::next(pointerBlockPair &entry)
+{
+    return nextN(&entry, 1) == 1;
+}
+
+int BPlusTreeCursor::nextN(pointerBlockPair* buffer, int maxEntries)
+{
+    // The current leaf and overflow node stay pinned until the batch is full or the range is done
+    void* leaf = leafNode != -1 ? tree->pinNode(leafNode) : nullptr;
+    void* overflow = overflowNode != -1 ? tree->pinNode(overflowNode) : nullptr;
+    int numEntries = 0;
+    while (numEntries < maxEntries) {
+        // Finish the overflow nodes of a duplicate key first
+        if (overflow != nullptr) {
+            pointerBlockPair* ptrArrOverflow = (pointerBlockPair*) (((NodeHeader*) overflow ) + 1 );
+            if (overflowIndex < *(unsigned int*)overflow) {
+                buffer[numEntries++] = ptrArrOverflow[overflowIndex++];
+                continue;
+            }
+            int nextOverflowNode = ptrArrOverflow[tree->maxKeys].blockId;
+            tree->unpinNode(overflowNode, false);
+            overflowNode = nextOverflowNode;
+            overflowIndex = 0;
+            overflow = nullptr;
+            if (overflowNode == -1) {
+                index++; // the last overflow node of the key has been read
+            } else {
+                numOverflowNodesAccessed++;
+                overflow = tree->pinNode(overflowNode);
+                tree->prefetchNode(((pointerBlockPair*) (((NodeHeader*) overflow ) + 1 ))[tree->maxKeys].blockId);
+            }
+            continue;
+        }
+
+        if (leaf == nullptr) break;
+        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) leaf ) + 1 );
+        unsigned int* numVotesArr = (unsigned int*) (ptrArr + tree->maxKeys + 1);
+
+        // End of the current leaf node has been reached, continue from the start of the next one
+        if (index >= *(unsigned int*)leaf) {
+            int nextLeafNode = ptrArr[tree->maxKeys].blockId;
+            tree->unpinNode(leafNode, false);
+            leafNode = nextLeafNode;
+            index = 0;
+            leaf = nullptr;
+            if (leafNode != -1) {
+                leaf = tree->pinNode(leafNode);
+                tree->prefetchNode(((pointerBlockPair*) (((NodeHeader*) leaf ) + 1 ))[tree->maxKeys].blockId);
+            }
+            continue;
+        }
+
+        if (numVotesArr[index] > numVotesEnd) {
+            tree->unpinNode(leafNode, false);
+            leafNode = -1;
+            leaf = nullptr;
+            break;
+        }
+        if (ptrArr[index].recordID == -1) { // Duplicates of the key are in overflow nodes
+            overflowNode = ptrArr[index].blockId;
+            overflowIndex = 0;
+            numOverflowNodesAccessed++;
+            overflow = tree->pinNode(overflowNode);
+            tree->prefetchNode(((pointerBlockPair*) (((NodeHeader*) overflow ) + 1 ))[tree->maxKeys].blockId);
+            continue;
+        }
+        buffer[numEntries++] = ptrArr[index++];
+    }
+    if (overflow != nullptr) tree->unpinNode(overflowNode, false);
+    if (leaf != nullptr) tree->unpinNode(leafNode, false);
+    return numEntries;
+}
+
+void BPlusTreeCursor::printStatistics(ofstream &output)
+{
+    if (output.is_open()) {
+        output << "\nTotal number of index nodes accessed: " << numIndexAccessed << "\n";
+        output << "Total number of overflow index nodes accessed: " << numOverflowNodesAccessed << "\n";
+        output << "Total number of index + overflow nodes accessed: " << (numOverflowNodesAccessed + numIndexAccessed) << "\n";
+        cout << "\nTotal number of index nodes accessed: " << numIndexAccessed << "\n";
+        cout << "Total number of overflow nodes accessed: " << numOverflowNodesAccessed << "\n";
+        cout << "Total number of index + overflow nodes accessed: " << (numOverflowNodesAccessed + numIndexAccessed) << "\n";
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef BPLUSTREECURSOR_H
+#define BPLUSTREECURSOR_H
+
+#include <fstream>
+#include "BPlusTree.h"
+#include "structures.h"
+
+using namespace std;
+
+// Streams the entries of a numVotes range out of a B+ Tree one at a time, in key order
+// Leaf and overflow nodes are only visited when the caller asks for their entries,
+// so a caller can stop early or process entries as they arrive without building a list of the whole range
+// The cursor keeps the ids of its nodes, which are pinned only during a call, so nextN() reads a batch with one pin per node
+// The tree must not be changed while a cursor is in use
+class BPlusTreeCursor
+{
+    public:
+    BPlusTree* tree;
+    unsigned int numVotesEnd;
+    int leafNode;           // id of the current leaf node, -1 once the range is done
+    unsigned int index;     // position of the next key in leafNode
+    int overflowNode;       // id of the overflow node of the key at index being read, -1 if none
+    unsigned int overflowIndex; // position of the next entry in overflowNode
+
+    //For Experiments
+    int numIndexAccessed;
+    int numOverflowNodesAccessed;
+
+    BPlusTreeCursor(BPlusTree* tree);
+
+    // Positions the cursor before the first entry with numVotesStart <= numVotes <= numVotesEnd
+    void seek(unsigned int numVotesStart, unsigned int numVotesEnd);
+    // Returns the next entry of the range in entry, false if there are no more
+    bool next(pointerBlockPair &entry);
+    // Copies up to maxEntries next entries of the range into buffer and returns how many there were, 0 at the end
+    int nextN(pointerBlockPair* buffer, int maxEntries);
+
+    void printStatistics(ofstream &output);
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "BitmapIndex.h"
+#include <cmath>
+
+BitmapIndex::BitmapIndex()
+{
+    bitmaps.resize(NUM_RATINGS);
+}
+
+int BitmapIndex::ratingTenths(float averageRating)
+{
+    long tenths = lround(averageRating * 10);
+    if (tenths < 0 || tenths >= NUM_RATINGS || tenths / 10.0f != averageRating) return -1;
+    return tenths;
+}
+
+void BitmapIndex::addRecord(unsigned int position, float averageRating)
+{
+    int tenths = ratingTenths(averageRating);
+    if (tenths == -1) {
+        otherRatings.add(position);
+    } else {
+        bitmaps[tenths].add(position);
+    }
+}
+
+void BitmapIndex::removeRecord(unsigned int position, float averageRating)
+{
+    int tenths = ratingTenths(averageRating);
+    if (tenths == -1) {
+        otherRatings.remove(position);
+    } else {
+        bitmaps[tenths].remove(position);
+    }
+}
+
+RoaringBitmap BitmapIndex::findRatings(float averageRatingStart, float averageRatingEnd)
+{
+    RoaringBitmap result;
+    for (int tenths = 0; tenths < NUM_RATINGS; tenths++) {
+        float averageRating = tenths / 10.0f;
+        if (averageRating >= averageRatingStart && averageRating <= averageRatingEnd) {
+            result = RoaringBitmap::orOf(result, bitmaps[tenths]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef BITMAPINDEX_H
+#define BITMAPINDEX_H
+
+#include <vector>
+#include "RoaringBitmap.h"
+
+using namespace std;
+
+// Bitmap index on averageRating, over record positions (blockId * MAX_RECORDS + slot)
+// averageRating has at most 101 distinct values (0.0 to 10.0 in tenths), each has a compressed bitmap of the records with it
+// Records whose averageRating is not a multiple of 0.1 in that range are kept in a bitmap of their own,
+// so queries know which records still need to be checked in their data block
+class BitmapIndex
+{
+    public:
+    static constexpr int NUM_RATINGS = 101;
+
+    vector<RoaringBitmap> bitmaps;  // bitmaps[t] holds the records with an averageRating of t/10
+    RoaringBitmap otherRatings;     // records whose averageRating has no bitmap
+
+    BitmapIndex();
+
+    // Returns averageRating in tenths if it has a bitmap, -1 otherwise
+    static int ratingTenths(float averageRating);
+
+    void addRecord(unsigned int position, float averageRating);
+    void removeRecord(unsigned int position, float averageRating);
+    // Returns the records with averageRatingStart <= averageRating <= averageRatingEnd, as the OR of their bitmaps
+    // Records in otherRatings are not included
+    RoaringBitmap findRatings(float averageRatingStart, float averageRatingEnd);
+};
+
+#endif
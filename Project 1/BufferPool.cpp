@@ -0,0 +1,285 @@
+#include "BufferPool.h"
+#include <iostream>
+#include <fstream>
+
+void partitionLatch::lock()
+{
+    state.fetch_or(WRITER, memory_order_acquire);
+    while ((state.load(memory_order_acquire) & ~WRITER) != 0) {
+        this_thread::yield();
+    }
+}
+
+bool partitionLatch::try_lock()
+{
+    int expected = 0;
+    return state.compare_exchange_strong(expected, WRITER, memory_order_acquire);
+}
+
+void partitionLatch::unlock()
+{
+    state.fetch_and(~WRITER, memory_order_release);
+}
+
+// A reader that arrives while WRITER is set backs out and waits, so a writer is never kept waiting by new readers
+void partitionLatch::lock_shared()
+{
+    while ((state.fetch_add(1, memory_order_acquire) & WRITER) != 0) {
+        state.fetch_sub(1, memory_order_relaxed);
+        while ((state.load(memory_order_relaxed) & WRITER) != 0) {
+            this_thread::yield();
+        }
+    }
+}
+
+void partitionLatch::unlock_shared()
+{
+    state.fetch_sub(1, memory_order_release);
+}
+
+BufferPool::BufferPool(DiskSimulator* disk, int numFrames)
+{
+    this->disk = disk;
+    this->blockSize = disk->blockSize;
+    this->numFrames = numFrames;
+
+    frames = malloc((size_t)numFrames * blockSize);
+    frameTable = new bufferFrame[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+        frameTable[i].blockAddress = nullptr;
+        frameTable[i].pinCount = 0;
+        frameTable[i].isDirty = false;
+        frameTable[i].referenceBit = false;
+    }
+    partitions = new pageTablePartition[NUM_PARTITIONS];
+    for (int i = 0; i < NUM_PARTITIONS; i++) {
+        partitions[i].pages.reserve(numFrames / NUM_PARTITIONS + 1);
+    }
+    clockHand = 0;
+
+    resetStatistics();
+}
+
+BufferPool::~BufferPool()
+{
+    flushAll();
+    delete[] partitions;
+    delete[] frameTable;
+    free(frames);
+}
+
+void* BufferPool::getFrame(int frameId)
+{
+    return (char*)frames + (size_t)frameId * blockSize;
+}
+
+// Neighbouring blocks go to different partitions
+pageTablePartition &BufferPool::partitionOf(void* blockAddress)
+{
+    return partitions[((uintptr_t)blockAddress / blockSize) % NUM_PARTITIONS];
+}
+
+// Pins a block, reading it from disk if it is not already cached
+// Returns the address of the frame holding the block, or nullptr if every frame is pinned
+void* BufferPool::pinBlock(void* blockAddress)
+{
+    pageTablePartition &partition = partitionOf(blockAddress);
+    {
+        shared_lock<partitionLatch> guard(partition.latch);
+        unordered_map<void*, int>::iterator entry = partition.pages.find(blockAddress);
+        if (entry != partition.pages.end()) {
+            partition.numHits++;
+            bufferFrame &frame = frameTable[entry->second];
+            frame.pinCount++;
+            if (!frame.referenceBit.load(memory_order_relaxed)) frame.referenceBit = true;
+            return getFrame(entry->second);
+        }
+    }
+
+    int frameId = pinLoadedBlock(blockAddress, true);
+    return frameId == -1 ? nullptr : getFrame(frameId);
+}
+
+// Pins a newly allocated block, since it holds no data yet it is not read from disk
+void* BufferPool::pinNewBlock(void* blockAddress)
+{
+    int frameId = pinLoadedBlock(blockAddress, false);
+    return frameId == -1 ? nullptr : getFrame(frameId);
+}
+
+// Loads a block into a frame and pins it, misses are handled one at a time under evictionLatch
+// Another thread may have loaded the block since pinBlock() missed it, it is then pinned where it is
+// Returns the id of the frame, or -1 if every frame is pinned
+int BufferPool::pinLoadedBlock(void* blockAddress, bool readFromDisk)
+{
+    lock_guard<mutex> evictionGuard(evictionLatch);
+    pageTablePartition &partition = partitionOf(blockAddress);
+    unique_lock<partitionLatch> guard(partition.latch);
+
+    unordered_map<void*, int>::iterator entry = partition.pages.find(blockAddress);
+    int frameId;
+    if (entry != partition.pages.end()) {
+        if (readFromDisk) partition.numHits++;
+        frameId = entry->second;
+    } else {
+        if (readFromDisk) partition.numMisses++;
+        frameId = loadBlock(blockAddress, readFromDisk, partition);
+        if (frameId == -1) return -1;
+    }
+
+    frameTable[frameId].pinCount++;
+    frameTable[frameId].referenceBit = true;
+    if (!readFromDisk) frameTable[frameId].isDirty = true;
+    return frameId;
+}
+
+void BufferPool::unpinBlock(void* blockAddress, bool isDirty)
+{
+    pageTablePartition &partition = partitionOf(blockAddress);
+    shared_lock<partitionLatch> guard(partition.latch);
+    unordered_map<void*, int>::iterator entry = partition.pages.find(blockAddress);
+    if (entry == partition.pages.end()) return; // not pinned, e.g. pinBlock() failed
+
+    bufferFrame &frame = frameTable[entry->second];
+    if (isDirty && !frame.isDirty.load(memory_order_relaxed)) frame.isDirty = true;
+    frame.pinCount--;
+}
+
+// Prefetching does not take a frame, the block is only read ahead on disk so that the later pinBlock() miss is cheap
+// A cached block is loaded from its frame into the CPU cache instead, so that reading the pinned frame does not stall
+void BufferPool::prefetchBlock(void* blockAddress)
+{
+    pageTablePartition &partition = partitionOf(blockAddress);
+    {
+        shared_lock<partitionLatch> guard(partition.latch);
+        unordered_map<void*, int>::iterator entry = partition.pages.find(blockAddress);
+        if (entry != partition.pages.end()) {
+            for (int offset = 0; offset < blockSize; offset += 64) {
+                __builtin_prefetch((char*)getFrame(entry->second) + offset);
+            }
+            return;
+        }
+    }
+    disk->prefetchBlock(blockAddress);
+}
+
+// Places a block into a free or evicted frame, copying its contents from disk if readFromDisk is set
+// Called with evictionLatch and the latch of the block's partition held
+int BufferPool::loadBlock(void* blockAddress, bool readFromDisk, pageTablePartition &partition)
+{
+    int frameId = findVictim(partition);
+    if (frameId == -1) {
+        printf("Buffer pool is full, all %d frames are pinned!\n", numFrames);
+        return -1;
+    }
+
+    bufferFrame &frame = frameTable[frameId];
+    if (readFromDisk) {
+        memcpy(getFrame(frameId), blockAddress, blockSize);
+    }
+    frame.blockAddress = blockAddress;
+    frame.pinCount = 0;
+    frame.isDirty = false;
+    frame.referenceBit = false;
+    partition.pages[blockAddress] = frameId;
+    return frameId;
+}
+
+// CLOCK replacement: sweep the frames, clearing reference bits, until an unpinned frame with a clear bit is found
+// Two full sweeps are enough to clear every reference bit, so after that all frames must be pinned
+// The victim's block is written back if it is dirty and dropped from its partition, whose latch is taken to make sure
+// that no thread pins it meanwhile; partition is the one of the block being loaded, which is already latched
+// The victim's latch is only tried, so partition latches are never waited for while one is held
+int BufferPool::findVictim(pageTablePartition &partition)
+{
+    bool skippedBusyFrame;
+    do { // a skipped frame may not be pinned, so the pool is only full if no frame was skipped
+        skippedBusyFrame = false;
+        for (int i = 0; i < 2 * numFrames; i++) {
+            bufferFrame &frame = frameTable[clockHand];
+            int frameId = clockHand;
+            clockHand = (clockHand + 1) % numFrames;
+
+            if (frame.blockAddress == nullptr) return frameId;
+            if (frame.pinCount > 0) continue;
+            if (frame.referenceBit) {
+                frame.referenceBit = false;
+                continue;
+            }
+
+            pageTablePartition &victimPartition = partitionOf(frame.blockAddress);
+            unique_lock<partitionLatch> victimGuard;
+            if (&victimPartition != &partition) {
+                victimGuard = unique_lock<partitionLatch>(victimPartition.latch, try_to_lock);
+                if (!victimGuard.owns_lock()) { // a thread is pinning or unpinning a block of that partition
+                    skippedBusyFrame = true;
+                    continue;
+                }
+            }
+            if (frame.pinCount > 0) continue; // pinned before its partition was latched
+
+            numEvictions++;
+            if (frame.isDirty) {
+                memcpy(frame.blockAddress, getFrame(frameId), blockSize);
+                numWritebacks++;
+            }
+            victimPartition.pages.erase(frame.blockAddress);
+            frame.blockAddress = nullptr;
+            return frameId;
+        }
+    } while (skippedBusyFrame);
+    return -1;
+}
+
+void BufferPool::discardBlock(void* blockAddress)
+{
+    lock_guard<mutex> evictionGuard(evictionLatch);
+    pageTablePartition &partition = partitionOf(blockAddress);
+    unique_lock<partitionLatch> guard(partition.latch);
+    unordered_map<void*, int>::iterator entry = partition.pages.find(blockAddress);
+    if (entry == partition.pages.end()) return;
+
+    bufferFrame &frame = frameTable[entry->second];
+    frame.blockAddress = nullptr;
+    frame.pinCount = 0;
+    frame.isDirty = false;
+    frame.referenceBit = false;
+    partition.pages.erase(entry);
+}
+
+void BufferPool::flushAll()
+{
+    lock_guard<mutex> evictionGuard(evictionLatch);
+    for (int i = 0; i < numFrames; i++) {
+        if (frameTable[i].blockAddress != nullptr && frameTable[i].isDirty) {
+            memcpy(frameTable[i].blockAddress, getFrame(i), blockSize);
+            frameTable[i].isDirty = false;
+            numWritebacks++;
+        }
+    }
+}
+
+void BufferPool::resetStatistics()
+{
+    lock_guard<mutex> evictionGuard(evictionLatch);
+    for (int i = 0; i < NUM_PARTITIONS; i++) {
+        partitions[i].numHits = 0;
+        partitions[i].numMisses = 0;
+    }
+    numEvictions = 0;
+    numWritebacks = 0;
+}
+
+// Prints the buffer pool counters since the last resetStatistics(), used for reporting statistics for experiments
+void BufferPool::printStatistics(ofstream &output)
+{
+    long long numHits = 0, numMisses = 0;
+    for (int i = 0; i < NUM_PARTITIONS; i++) {
+        numHits += partitions[i].numHits;
+        numMisses += partitions[i].numMisses;
+    }
+    output << "Buffer pool hits / misses / evictions (" << numFrames << " frames): "
+        << numHits << " / " << numMisses << " / " << numEvictions << "\n";
+    cout << "Buffer pool hits / misses / evictions (" << numFrames << " frames): "
+        << numHits << " / " << numMisses << " / " << numEvictions << "\n";
+}
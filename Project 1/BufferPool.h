@@ -0,0 +1,105 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include "DiskSimulator.h"
+
+using namespace std;
+
+// Bookkeeping for one frame of the buffer pool
+// blockAddress only changes under BufferPool::evictionLatch and the latch of the block's partition,
+// the other fields are atomic since pinning threads update them under a shared partition latch
+struct bufferFrame
+{
+    void* blockAddress;         // address of the disk block held in this frame, nullptr if the frame is empty
+    atomic<int> pinCount;       // number of users currently holding the frame, a pinned frame is never evicted
+    atomic<bool> isDirty;       // frame was modified and must be written back to disk before eviction
+    atomic<bool> referenceBit;  // set on every access, cleared by the clock hand to give the frame a second chance
+};
+
+// Reader-writer latch of one page table partition, kept in a single word so that a shared lock is one atomic add
+// The lower bits count the readers, WRITER is set while a writer holds the latch or waits for the readers to leave
+// Only threads holding BufferPool::evictionLatch take it exclusively, so there is never more than one writer
+// The functions are named like those of shared_mutex so that lock_guard, unique_lock and shared_lock can be used
+struct partitionLatch
+{
+    static constexpr int WRITER = 1 << 30;
+    atomic<int> state{0};
+
+    void lock();
+    bool try_lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+};
+
+// One part of the page table, blocks are spread over the partitions by their position on disk
+// A pin or unpin of a cached block only takes the latch of its partition, and only in shared mode,
+// so threads pinning different blocks, or the same block, do not wait for each other
+struct alignas(64) pageTablePartition
+{
+    partitionLatch latch;
+    unordered_map<void*, int> pages;    // maps a disk block address to the frame holding it
+
+    //For Experiments, kept per partition so that counting a hit does not write a cache line shared by every thread
+    atomic<int> numHits;
+    atomic<int> numMisses;
+};
+
+// Caches a bounded number of disk blocks in memory, evicting with the CLOCK replacement policy
+// Blocks are identified by their address on disk, pinBlock() returns the address of the frame holding a copy
+// The frame address is only valid until the block is unpinned
+// Several threads may pin and unpin blocks at once, e.g. the threads using the B+ Tree
+// Hits only take a shared latch on one partition of the page table, misses are loaded one at a time under evictionLatch
+class BufferPool
+{
+    public:
+    DiskSimulator* disk;
+    int blockSize;
+    int numFrames;
+    void* frames;                       // numFrames frames of blockSize bytes each
+    bufferFrame* frameTable;
+    static constexpr int NUM_PARTITIONS = 64;
+    pageTablePartition* partitions;     // NUM_PARTITIONS parts of the page table
+    int clockHand;
+    mutex evictionLatch;    // held while a block is loaded into a frame or dropped from one, and by flushAll()
+
+    //For Experiments, hits and misses are counted in the partitions
+    int numEvictions;
+    int numWritebacks;
+
+    BufferPool(DiskSimulator* disk, int numFrames);
+    ~BufferPool();
+
+    // Pins a block, reading it from disk into a frame if it is not cached
+    void* pinBlock(void* blockAddress);
+    // Pins a block that was just allocated on disk, its frame is not read from disk
+    void* pinNewBlock(void* blockAddress);
+    // Releases a pin on a block, isDirty marks the block as modified
+    void unpinBlock(void* blockAddress, bool isDirty);
+    // Starts reading a block that will be pinned soon, from disk if it is not cached, else from its frame into the CPU cache
+    void prefetchBlock(void* blockAddress);
+
+    // Drops a cached block without writing it back, used when the block is released on disk
+    void discardBlock(void* blockAddress);
+    // Writes every dirty frame back to disk
+    void flushAll();
+
+    //Functions for Experiments
+    void resetStatistics();
+    void printStatistics(ofstream &output);
+
+    private:
+    void* getFrame(int frameId);
+    pageTablePartition &partitionOf(void* blockAddress);
+    int findVictim(pageTablePartition &partition);
+    int loadBlock(void* blockAddress, bool readFromDisk, pageTablePartition &partition);
+    int pinLoadedBlock(void* blockAddress, bool readFromDisk);
+};
+
+#endif
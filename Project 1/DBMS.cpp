@@ -1,22 +1,143 @@
 #include "DBMS.h"
 #include "data_loader.h"
 #include <chrono>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <atomic>
 
-DBMS::DBMS(unsigned int diskSize, unsigned int blockSize)
+DBMS::DBMS(unsigned int diskSize, unsigned int blockSize, const char* diskFile, unsigned int bufferFrames, blockLayout layout,
+    bool compactRecords, bool coveringIndex, bool clustered, float indexFillFactor)
 {
     DISK_SIZE = diskSize; // calculated in MB
     BLOCK_SIZE = blockSize; // calculated in B
-    MAX_RECORDS = (BLOCK_SIZE - sizeof(unsigned int))/(sizeof(movieRecord) + sizeof(indexMapping)); // maximum number of movieRecords for a block
+    LAYOUT = layout;
+    COMPACT_RECORDS = compactRecords;
+    COVERING_INDEX = coveringIndex;
+    CLUSTERED = clustered;
+    PREFETCH_DEPTH = 32;
+    CURSOR_BATCH = 256;
+    SCAN_THREADS = max(1u, thread::hardware_concurrency());
+    SCAN_CHUNK_BLOCKS = 256;
 
-    freeBlocks = {}; // Allows for tracking of blocks that can still accomodate additional records
-    disk = new DiskSimulator(DISK_SIZE, BLOCK_SIZE);
-    bPlusTree = new BPlusTree(BLOCK_SIZE);
+    if (COMPACT_RECORDS) {
+        RECORD_SIZE = sizeof(compactRecord);
+    } else if (LAYOUT == PAX_LAYOUT) {
+        // A PAX record has no padding, its attributes are spread over the minipages
+        RECORD_SIZE = sizeof(unsigned int) + sizeof(float) + sizeof(unsigned int) + sizeof(movieRecord::tconst);
+    } else {
+        RECORD_SIZE = sizeof(movieRecord);
+    }
+    // maximum number of movieRecords for a block, each record takes RECORD_SIZE bytes and one bit of the presence bitmap
+    MAX_RECORDS = ((BLOCK_SIZE - sizeof(dataBlockHeader)) * 8) / (RECORD_SIZE * 8 + 1);
+    while (sizeof(dataBlockHeader) + (MAX_RECORDS + 31) / 32 * sizeof(unsigned int) + MAX_RECORDS * RECORD_SIZE > (unsigned int)BLOCK_SIZE) {
+        MAX_RECORDS--; // the bitmap is rounded up to whole words
+    }
+    PRESENCE_WORDS = (MAX_RECORDS + 31) / 32;
+    // about 1 slot in 8 is left free in every clustered block, at least 1
+    CLUSTERED_FILL = max(1, MAX_RECORDS - max(1, MAX_RECORDS / 8));
+    INDEX_FILL_FACTOR = indexFillFactor;
+    bulkLoadBlockId = -1;
+
+    RECORD_ID_OFFSET = AVERAGE_RATING_OFFSET = NUM_VOTES_OFFSET = TCONST_OFFSET = 0;
+    if (LAYOUT == PAX_LAYOUT && COMPACT_RECORDS) {
+        RECORD_ID_OFFSET = sizeof(dataBlockHeader) + PRESENCE_WORDS * sizeof(unsigned int);
+        NUM_VOTES_OFFSET = AVERAGE_RATING_OFFSET = RECORD_ID_OFFSET + MAX_RECORDS * sizeof(unsigned int);
+        TCONST_OFFSET = NUM_VOTES_OFFSET + MAX_RECORDS * sizeof(unsigned int);
+    } else if (LAYOUT == PAX_LAYOUT) {
+        // The 4 byte minipages come first so that every column stays aligned
+        RECORD_ID_OFFSET = sizeof(dataBlockHeader) + PRESENCE_WORDS * sizeof(unsigned int);
+        AVERAGE_RATING_OFFSET = RECORD_ID_OFFSET + MAX_RECORDS * sizeof(unsigned int);
+        NUM_VOTES_OFFSET = AVERAGE_RATING_OFFSET + MAX_RECORDS * sizeof(float);
+        TCONST_OFFSET = NUM_VOTES_OFFSET + MAX_RECORDS * sizeof(unsigned int);
+    }
+
+    freeSpaceMap = new FreeSpaceMap(MAX_RECORDS); // Allows for tracking of blocks that can still accomodate additional records
+    zoneMap = new ZoneMap();
+    if (diskFile == nullptr) {
+        disk = new DiskSimulator(DISK_SIZE, BLOCK_SIZE);
+    } else {
+        disk = new DiskSimulator(DISK_SIZE, BLOCK_SIZE, diskFile);
+    }
+    // The layout and encoding of a disk file's data blocks are recorded when it is created, a reopen with others would misread them
+    if (disk->fileHeader != nullptr && !disk->isReopened) {
+        disk->fileHeader->layout = LAYOUT;
+        disk->fileHeader->isCompact = COMPACT_RECORDS;
+    } else if (disk->isReopened && disk->fileHeader->layout != LAYOUT) {
+        printf("%s was loaded with the %s layout, reopen it with --layout %s\n", diskFile,
+            disk->fileHeader->layout == PAX_LAYOUT ? "PAX" : "row", disk->fileHeader->layout == PAX_LAYOUT ? "pax" : "row");
+        exit(1);
+    } else if (disk->isReopened && disk->fileHeader->isCompact != COMPACT_RECORDS) {
+        printf("%s was loaded with the %s encoding, reopen it with --encoding %s\n", diskFile,
+            disk->fileHeader->isCompact ? "compact" : "plain", disk->fileHeader->isCompact ? "compact" : "plain");
+        exit(1);
+    }
+    bufferPool = new BufferPool(disk, bufferFrames);
+    scanKernel = new ScanKernel();
     numBlocks = 0;
+    numRecords = 0;
+    dataSegment = disk->createSegment();
+    hashIndexSegment = disk->createSegment();
+    indexSegment = disk->createSegment();
+    bPlusTree = new BPlusTree(BLOCK_SIZE, disk, bufferPool, indexSegment);
+    hashIndex = new HashIndex(disk, bufferPool, hashIndexSegment);
+    ratingIndex = new BitmapIndex();
+
+    if (disk->isReopened) {
+        loadFromDisk();
+    }
 }
 
 DBMS::~DBMS() {
-    free(disk);
-    free(bPlusTree);
+    delete hashIndex;
+    delete ratingIndex;
+    delete bPlusTree; // records the tree in its header block, which the buffer pool writes back
+    delete bufferPool; // writes back dirty blocks before the disk goes away
+    delete disk;
+    delete freeSpaceMap;
+    delete zoneMap;
+    delete scanKernel;
+}
+
+// Rebuilds the in-memory state of the DBMS (free space map, zone map, bitmap index, counters, and the B+ Tree if it was not saved)
+// from the data blocks of a reopened file-backed disk, instead of importing the tsv file again
+// The hash index and a B+ Tree closed by the last run are already on the disk, and are used as they are
+void DBMS::loadFromDisk()
+{
+    cout << "Reopening database from disk file, please wait..." << endl;
+
+    for (int blockId : disk->getSegmentBlockIds(dataSegment)) {
+        void* blockAddress = disk->fetchBlockAddress(blockId);
+        numBlocks++;
+
+        dataBlockHeader* header = (dataBlockHeader*)blockAddress;
+        unsigned int* presence = presenceBitmap(blockAddress);
+
+        // Live records are the slots set in the presence bitmap
+        for (int word = 0; word < PRESENCE_WORDS; word++) {
+            for (unsigned int bits = presence[word]; bits != 0; bits &= bits - 1) {
+                int slot = word * 32 + __builtin_ctz(bits);
+                unsigned int numVotes = readNumVotes(blockAddress, slot);
+                float averageRating = readAverageRating(blockAddress, slot);
+                if (!bPlusTree->isLoaded) {
+                    bulkLoadRecords.push_back({numVotes, makeIndexEntry(blockId, readRecordID(blockAddress, slot), slot, averageRating)});
+                }
+                zoneMap->addRecord(blockId, numVotes, averageRating);
+                ratingIndex->addRecord(recordPosition(blockId, slot), averageRating);
+                if (!hashIndex->isLoaded) {
+                    // the index is rebuilt when the last run did not close it, or the disk was written before it existed
+                    char tconst[11];
+                    readTconst(blockAddress, slot, tconst);
+                    hashIndex->insertEntry(tconst, {0, readRecordID(blockAddress, slot), blockId, (unsigned int) slot});
+                }
+            }
+        }
+        numRecords += header->numRecords;
+
+        freeSpaceMap->updateBlock(blockId, MAX_RECORDS - header->numRecords);
+    }
+    finishBulkLoad();
+    cout << "Total number of records reopened: " << numRecords << endl;
 }
 
 // Imports record data from the tsv file
@@ -31,94 +152,150 @@ void DBMS::importData(std::string tsv_file)
 
     this->numRecords = 0;
 
+    // Clustered data blocks are filled in numVotes order, records with the same numVotes keep their file order
+    if (CLUSTERED) {
+        stable_sort(data.begin(), data.end(), [](const movieRecord &a, const movieRecord &b) {
+            return a.numVotes < b.numVotes;
+        });
+    }
+
     // Loop over the data and insert all the movie records
     for (auto movie_record_address = data.begin();
          movie_record_address != data.end();
          ++movie_record_address)
     {
-        insertRecord(*movie_record_address);  
+        if (!insertRecord(*movie_record_address, true)) continue; // rejected records are not counted
         this->numRecords++;
         if (this->numRecords % 10000 == 0){ // Update user for each 10,000 records entered
             cout << "Number of records inserted thus far: " << this->numRecords << endl;
         }
     }
+    finishBulkLoad();
     cout << "\n============\n"
         "Total number of records inserted: " << this->numRecords << endl;
 }
 
 
 // Inserts a movieRecord and updates the B+ Tree
-void DBMS::insertRecord(movieRecord toInsert)
+// isBulkLoad is set by importData(): the B+ Tree entry is only added by finishBulkLoad(),
+// and clustered data blocks are only filled up to CLUSTERED_FILL records
+// Returns false if the record could not be stored
+bool DBMS::insertRecord(movieRecord toInsert, bool isBulkLoad)
 {
     // note that checking if record is already inserted should be done in the B+ tree implementation
+    if (COMPACT_RECORDS && !canEncode(toInsert)) {
+        printf("Record %u cannot be stored as a compact record!\n", toInsert.recordID);
+        return false;
+    }
+
     void* blockAddress;
     void* blockToInsert;
-    unsigned int* numRecords;
-    indexMapping* indexMappingTable;
+    dataBlockHeader* header;
+    unsigned int* presence;
 
     //Retrieve a block for insertion of record, get new block from disk if all blocks are fully filled
-    if (freeBlocks.size() == 0) {
+    //Clustered records go next to their numVotes neighbours instead, in a new overflow block if the neighbouring blocks are full
+    int blockId;
+    if (CLUSTERED && isBulkLoad) {
+        // importData() inserts in numVotes order, so the neighbour of a record is the one bulk loaded before it
+        blockId = freeSpaceMap->numFreeSlots(bulkLoadBlockId) > MAX_RECORDS - CLUSTERED_FILL ? bulkLoadBlockId : -1;
+    } else if (CLUSTERED) {
+        blockId = findClusteredBlock(toInsert.numVotes, isBulkLoad ? CLUSTERED_FILL : MAX_RECORDS);
+        if (blockId == -1 && disk->getUnusedBlock(dataSegment) == nullptr) {
+            blockId = freeSpaceMap->findBlockWithSpace(); // out of order rather than not at all once the disk is full
+        }
+    } else {
+        blockId = freeSpaceMap->findBlockWithSpace();
+    }
+    if (blockId == -1) {
         // no free blocks, get a new one and initialize header information
-        blockAddress = disk->getUnusedBlock();
+        blockAddress = disk->getUnusedBlock(dataSegment);
+        if (blockAddress == nullptr) {
+            printf("Disk is full, record %u cannot be inserted!\n", toInsert.recordID);
+            return false;
+        }
+        blockToInsert = bufferPool->pinNewBlock(blockAddress);
+        if (blockToInsert == nullptr) {
+            printf("Buffer pool is full, record %u cannot be inserted!\n", toInsert.recordID);
+            return false;
+        }
         disk->updateMapTable(blockAddress);
         numBlocks++;
-        freeBlocks.push_front(blockAddress);
-        blockToInsert = blockAddress;
-        numRecords = (unsigned int*)blockToInsert;
-        *numRecords = 0; // initialize first 4 bytes to be 0
+        blockId = disk->getBlockId(blockAddress);
+        header = (dataBlockHeader*)blockToInsert;
+        header->numRecords = 0; // initialize header information
+        memset(presenceBitmap(blockToInsert), 0, PRESENCE_WORDS * sizeof(unsigned int));
     }
     else {
-        blockAddress = freeBlocks.front();        
-        blockToInsert = blockAddress;
-        numRecords = (unsigned int*)blockToInsert;
-    }
-
-    if(initialBlockPtr==nullptr)    initialBlockPtr = blockToInsert;
-    
-    indexMappingTable = (indexMapping*)(numRecords + 1); // pointer to start of indexMapping table, starts directly after numRecords
-    movieRecord* tail = (movieRecord*)((char*)blockToInsert + BLOCK_SIZE - sizeof(movieRecord)); // pointer to record slot at bottom of the block
-
-    // Setting insertRecordPointer to point to the space for insertion of record
-    // Records are inserted starting from the back of the block
-    movieRecord* insertRecordPointer = tail - *numRecords;
-    indexMapping* insertindexMappingPointer = indexMappingTable + *numRecords;
-
-    // Search for gravestones which indicate free spaces within the blocks for record insertion
-    int numGravestones = 0;
-    int index = *numRecords;
-    for(unsigned int i = 0; i<*numRecords; i++)
-    {
-        if ((indexMappingTable + i)->indexOfRecord == -1)
-        {
-            // Replace last gravestone
-            insertRecordPointer = tail - i;
-            insertindexMappingPointer = indexMappingTable + i;
-            index = i;
-            numGravestones++;
+        blockAddress = disk->fetchBlockAddress(blockId);
+        blockToInsert = bufferPool->pinBlock(blockAddress);
+        if (blockToInsert == nullptr) {
+            printf("Buffer pool is full, record %u cannot be inserted!\n", toInsert.recordID);
+            return false;
         }
+        header = (dataBlockHeader*)blockToInsert;
     }
+    
+    presence = presenceBitmap(blockToInsert); // pointer to start of presence bitmap, starts directly after the header
 
-    if (numGravestones > 0) 
-    {
-        numGravestones--; // revive a single gravestone
-        (*numRecords)--; // to keep numRecords unchanged when it is incremented later
+    // The first clear bit of the presence bitmap is a free slot, the free space map only hands out blocks that have one
+    // so slots freed by deletions are reused before the slots after them
+    int index = 0;
+    for (int word = 0; word < PRESENCE_WORDS; word++) {
+        if (presence[word] != 0xFFFFFFFF) {
+            index = word * 32 + __builtin_ctz(~presence[word]);
+            break;
+        }
     }
     
     // Insert record to disk
-    *insertRecordPointer = toInsert; // insert record data
-    *insertindexMappingPointer = {toInsert.recordID, index}; // insert new indexMapping table entry
-    (*numRecords)++;
+    writeRecord(blockToInsert, index, toInsert); // insert record data
+    presence[index / 32] |= 1u << (index % 32); // mark slot as in use
+    header->numRecords++;
 
     // Update B+ Tree with new record inserted
-    bPlusTree->insertRecord(toInsert.numVotes, {blockAddress, (int) toInsert.recordID});
-
-    // Remove block from list of freeblocks if updated block cannot hold any more records
-    if (*numRecords == MAX_RECORDS && numGravestones == 0)
-    {
-        freeBlocks.pop_front();
+    pointerBlockPair indexEntry = makeIndexEntry(blockId, toInsert.recordID, index, toInsert.averageRating);
+    if (isBulkLoad) {
+        bulkLoadRecords.push_back({toInsert.numVotes, indexEntry});
+        bulkLoadBlockId = blockId;
+    } else {
+        bPlusTree->insertRecord(toInsert.numVotes, indexEntry);
     }
+    zoneMap->addRecord(blockId, toInsert.numVotes, toInsert.averageRating);
+    hashIndex->insertEntry(toInsert.tconst, {0, toInsert.recordID, blockId, (unsigned int) index});
+    ratingIndex->addRecord(recordPosition(blockId, index), toInsert.averageRating);
+
+    // Move block to the bucket for its remaining space, a block that cannot hold any more records leaves the free space map
+    freeSpaceMap->updateBlock(blockId, MAX_RECORDS - header->numRecords);
+    bufferPool->unpinBlock(blockAddress, true);
+
+    return true;
+}
 
-    return;
+// Builds the B+ Tree from the entries of the records bulk loaded since the last call, all at once
+void DBMS::finishBulkLoad(){
+    bPlusTree->bulkLoad(bulkLoadRecords, INDEX_FILL_FACTOR);
+    bulkLoadRecords.clear();
+    bulkLoadRecords.shrink_to_fit();
+    bulkLoadBlockId = -1;
+}
+
+// Returns the id of the data block a record should be inserted into to keep the data blocks clustered on numVotes,
+// or -1 if a new block should be started
+// The block holding the closest smaller or equal numVotes is preferred, then the one holding the next larger numVotes,
+// each only if it holds fewer than maxRecordsInBlock records
+int DBMS::findClusteredBlock(unsigned int numVotes, int maxRecordsInBlock){
+    pointerBlockPair before, after;
+    bPlusTree->findNeighbours(numVotes, before, after);
+
+    for (pointerBlockPair neighbour : {before, after}) {
+        if (neighbour.blockId == -1) continue;
+        int blockId = neighbour.blockId;
+        if (freeSpaceMap->numFreeSlots(blockId) > MAX_RECORDS - maxRecordsInBlock) {
+            return blockId;
+        }
+    }
+    return -1;
 }
 
 // Finds records, used for both range queries and single value queries
@@ -130,64 +307,95 @@ void DBMS::findRecords(unsigned int numVotesStart, unsigned int numVotesEnd, ofs
     chrono::system_clock::time_point start, end;
     start = chrono::system_clock::now();
 
-    list<pointerBlockPair> results = bPlusTree->findRecord(numVotesStart, numVotesEnd, output);
+    bufferPool->resetStatistics();
 
-    set<void*> accessedBlocks; // to avoid counting and printing blocks more than once
+    int numOfBlockAccessed = 0;
+    unsigned long numOfRecords = 0;
 
     float sumOfAverageRating = 0;
 
-    for (pointerBlockPair recordLocation : results) {
-        movieRecord* record = retrieveRecord(recordLocation, accessedBlocks);
-        sumOfAverageRating += record->averageRating;
+    // The entries are streamed out of the B+ Tree a batch at a time
+    // With a covering index, only entries without an included averageRating need their data block
+    // The others are grouped by data block in disk order, so that every block is read once for all of its records
+    vector<pointerBlockPair> recordsToFetch;
+    vector<pointerBlockPair> entries(CURSOR_BATCH);
+    BPlusTreeCursor cursor(bPlusTree);
+    cursor.seek(numVotesStart, numVotesEnd);
+    for (int numEntries; (numEntries = cursor.nextN(entries.data(), CURSOR_BATCH)) > 0; ) {
+        numOfRecords += numEntries;
+        for (int i = 0; i < numEntries; i++) {
+            if (COVERING_INDEX && entries[i].averageRatingTenths != RATING_NOT_INCLUDED) {
+                sumOfAverageRating += entries[i].averageRatingTenths / 10.0f;
+            } else {
+                recordsToFetch.push_back(entries[i]);
+            }
+        }
+    }
+    cursor.printStatistics(output);
+    sort(recordsToFetch.begin(), recordsToFetch.end(), [](const pointerBlockPair &a, const pointerBlockPair &b) {
+        return a.blockId != b.blockId ? a.blockId < b.blockId : a.slot < b.slot;
+    });
+
+    // Start reading the first blocks in the background, then stay PREFETCH_DEPTH blocks ahead of the block being read
+    size_t prefetchIndex = 0;
+    auto prefetchNextBlock = [&]() {
+        if (prefetchIndex >= recordsToFetch.size()) return;
+        int blockId = recordsToFetch[prefetchIndex].blockId;
+        bufferPool->prefetchBlock(disk->fetchBlockAddress(blockId));
+        while (prefetchIndex < recordsToFetch.size() && recordsToFetch[prefetchIndex].blockId == blockId) {
+            prefetchIndex++;
+        }
+    };
+    for (int i = 0; i < PREFETCH_DEPTH; i++) {
+        prefetchNextBlock();
+    }
+
+    for (size_t first = 0, last; first < recordsToFetch.size(); first = last) {
+        last = first + 1;
+        while (last < recordsToFetch.size() && recordsToFetch[last].blockId == recordsToFetch[first].blockId) {
+            last++;
+        }
+        prefetchNextBlock();
+        if (retrieveBlockRecords(recordsToFetch.data() + first, recordsToFetch.data() + last, sumOfAverageRating) != -1) {
+            numOfBlockAccessed++;
+        }
     }
     // clock ends
     end = chrono::system_clock::now();
     double elapsed = chrono::duration_cast<chrono::microseconds>(end-start).count();
 
-    float average = sumOfAverageRating / results.size();
+    float average = sumOfAverageRating / numOfRecords;
 
     // print to file
-    output << "\nTotal number of records retrieved: " << results.size() << "\n";
-    output << "Total number of data blocks the process accessed: " << accessedBlocks.size() << "\n";
+    output << "\nTotal number of records retrieved: " << numOfRecords << "\n";
+    output << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
     output << "The average of 'averageRating' of the records: " << average << "\n";
     output << "The running time of the retrieval process (measured by chrono::system_clock): " << elapsed / 1000 <<  " ms" << "\n";
     
     // print to screen
-    cout << "Total number of records retrieved: " << results.size() << "\n";
-    cout << "Total number of data blocks the process accessed: " << accessedBlocks.size() << "\n";
+    cout << "Total number of records retrieved: " << numOfRecords << "\n";
+    cout << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
     cout << "The average of 'averageRating' of the records: " << average << "\n";
     cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
+    bufferPool->printStatistics(output);
 }
 
 // Brute-force linear scan method
 // Only print the number of data blocks accessed
 // For Experiment 3, 4, 5
 void DBMS::findRecordsBF(unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output){
-    cout << "\nScan through a brute-force linear method..." << "\n\n";
+    cout << "\nScan through a brute-force linear method (" << scanKernel->name << " scan kernel, " << SCAN_THREADS << " threads)..." << "\n\n";
 
     int numOfBlockAccessed = 0;
-    int numOfNumVotes = 0;
-    set<void*> accessedBlocks; // to avoid counting and printing blocks more than once
+    int numOfBlockSkipped = 0;
     double sumOfAverageRating = 0;
 
     // clock starts
     chrono::system_clock::time_point start, end;
     start = chrono::system_clock::now();
+    bufferPool->resetStatistics();
 
-    for(int blockID=0;blockID<numBlocks;blockID++){
-        numOfBlockAccessed++;
-        void* blockPtr = (void*)((char*)this->initialBlockPtr + blockID * BLOCK_SIZE);
-
-        for(int recID=1;recID<=MAX_RECORDS;recID++){
-            pointerBlockPair recordLocation = {blockPtr, recID + blockID * MAX_RECORDS};
-            movieRecord* record = retrieveRecord(recordLocation, accessedBlocks);
-            if(record==nullptr) break;
-            if(record->numVotes >= numVotesStart && record->numVotes <= numVotesEnd){
-                numOfNumVotes++;
-                sumOfAverageRating += record->averageRating;
-            }
-        }
-    }
+    int numOfNumVotes = scanDataBlocks(numVotesStart, numVotesEnd, numOfBlockAccessed, numOfBlockSkipped, sumOfAverageRating, nullptr);
 
     // clock ends
     end = chrono::system_clock::now();
@@ -195,49 +403,500 @@ void DBMS::findRecordsBF(unsigned int numVotesStart, unsigned int numVotesEnd, o
 
 
     output << "The number of data blocks accessed if a brute-force linear scan used: " << numOfBlockAccessed << "\n";
+    output << "The number of data blocks skipped using zone maps: " << numOfBlockSkipped << "\n";
     output << "The running time of the retrieval process (measured by chrono::system_clock): " << elapsed / 1000 <<  " ms" << "\n";
     cout << "The number of data blocks accessed if a brute-force linear scan is used: " << numOfBlockAccessed << "\n";
+    cout << "The number of data blocks skipped using zone maps: " << numOfBlockSkipped << "\n";
     cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
     cout << "***Number of records retrieved: " << numOfNumVotes << endl;
     cout << "***Average Rating: " << sumOfAverageRating / numOfNumVotes << endl;
+    bufferPool->printStatistics(output);
 }
 
-//Retrieves record, used in findRecords() to get the records required from disk
-movieRecord* DBMS::retrieveRecord(pointerBlockPair recordToRetrieve, set<void*> &accessedBlocks){
+// Finds the record of a movie by its tconst through the hash index
+// Reads the bucket of tconst, then the data block of each entry with a matching hash to compare the tconst itself
+void DBMS::findRecordByTconst(const char* tconst, ofstream &output){
+    printf("Retrieving record from disk..\n");
 
-    void* blockToRetrieve = recordToRetrieve.blockAddress;
+    // clock starts
+    chrono::system_clock::time_point start, end;
+    start = chrono::system_clock::now();
+    bufferPool->resetStatistics();
 
-    accessedBlocks.insert(blockToRetrieve);
+    vector<hashIndexEntry> entries = hashIndex->findEntries(tconst);
+    int numOfBlockAccessed = 0;
+    list<movieRecord> results;
+    for (hashIndexEntry &entry : entries) {
+        if (disk->isBlockUnused(entry.blockId)) continue;
+        numOfBlockAccessed++;
 
-    unsigned int* numOfRecords = (unsigned int*)blockToRetrieve;
-    indexMapping* indexMappingTable = (indexMapping*)(numOfRecords + 1); // Pointer to start of indexMapping table, starts directly after numRecords
-    movieRecord* tail = (movieRecord*)((char*)blockToRetrieve + BLOCK_SIZE - sizeof(movieRecord)); // Pointer to start of record slot at bottom of the block
-    
-    for (int i = 0; i <= *numOfRecords; i++){
-        if (indexMappingTable->recordID == recordToRetrieve.recordID && indexMappingTable->indexOfRecord != -1){
-            movieRecord* recordPointer = tail - indexMappingTable->indexOfRecord;
-            return recordPointer;
-        } else {
-            indexMappingTable++;
+        void* blockAddress = disk->fetchBlockAddress(entry.blockId);
+        void* block = pinBlockForReading(blockAddress);
+        int position = findRecordPosition(block, entry.slot, entry.recordID);
+        char recordTconst[11];
+        if (position != -1) {
+            readTconst(block, position, recordTconst);
+        }
+        if (position != -1 && strcmp(recordTconst, tconst) == 0) {
+            movieRecord record;
+            readRecord(block, position, record);
+            results.push_back(record);
+        }
+        unpinBlockForReading(blockAddress, block);
+    }
+
+    // clock ends
+    end = chrono::system_clock::now();
+    double elapsed = chrono::duration_cast<chrono::microseconds>(end-start).count();
+
+    char toPrint[80];
+    for (movieRecord &record : results) {
+        snprintf(toPrint, 80, "%s | averageRating %.1f | numVotes %u", record.tconst, record.averageRating, record.numVotes);
+        output << toPrint << "\n";
+        cout << toPrint << "\n";
+    }
+    if (results.empty()) {
+        output << "No movie with tconst " << tconst << "\n";
+        cout << "No movie with tconst " << tconst << "\n";
+    }
+    output << "Total number of hash index blocks accessed: " << hashIndex->numBlocksAccessed << "\n";
+    output << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
+    output << "The running time of the retrieval process (measured by chrono::system_clock): " << elapsed / 1000 <<  " ms" << "\n";
+    cout << "Total number of hash index blocks accessed: " << hashIndex->numBlocksAccessed << "\n";
+    cout << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
+    cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
+    bufferPool->printStatistics(output);
+}
+
+// Finds the records with an averageRating in a range and numVotes in a range, e.g. movies rated 8.0 to 10.0 with 30,000 to 40,000 votes
+// Reports the number of records and the average of their averageRating
+void DBMS::findRecordsByRating(float averageRatingStart, float averageRatingEnd, unsigned int numVotesStart, unsigned int numVotesEnd,
+    ofstream &output){
+    printf("Retrieving records with the averageRating bitmap index..\n");
+
+    // clock starts
+    chrono::system_clock::time_point start, end;
+    start = chrono::system_clock::now();
+    bufferPool->resetStatistics();
+
+    double sumOfAverageRating = 0;
+    int numOfBlockAccessed = 0;
+    unsigned long numOfRecords = matchRatingAndNumVotes(averageRatingStart, averageRatingEnd, numVotesStart, numVotesEnd,
+        sumOfAverageRating, numOfBlockAccessed, output);
+
+    // clock ends
+    end = chrono::system_clock::now();
+    double elapsed = chrono::duration_cast<chrono::microseconds>(end-start).count();
+
+    float average = sumOfAverageRating / numOfRecords;
+
+    output << "\nTotal number of records retrieved: " << numOfRecords << "\n";
+    output << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
+    output << "The average of 'averageRating' of the records: " << average << "\n";
+    output << "The running time of the retrieval process (measured by chrono::system_clock): " << elapsed / 1000 <<  " ms" << "\n";
+    cout << "Total number of records retrieved: " << numOfRecords << "\n";
+    cout << "Total number of data blocks the process accessed: " << numOfBlockAccessed << "\n";
+    cout << "The average of 'averageRating' of the records: " << average << "\n";
+    cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
+    bufferPool->printStatistics(output);
+}
+
+// Counts the records matching both ranges and sums their averageRating, returns the number of records
+// The numVotes range comes from the B+ Tree as a bitmap of record positions, which is ANDed with the bitmaps of the ratings in range
+// A rating's matches only need to be counted to add to the sum, so no data block is read except for records in otherRatings,
+// and only if the zone map of their block overlaps the averageRating range
+unsigned long DBMS::matchRatingAndNumVotes(float averageRatingStart, float averageRatingEnd, unsigned int numVotesStart,
+    unsigned int numVotesEnd, double &sumOfAverageRating, int &numOfBlockAccessed, ofstream &output){
+
+    vector<unsigned int> positions;
+    BPlusTreeCursor cursor(bPlusTree);
+    cursor.seek(numVotesStart, numVotesEnd);
+    vector<pointerBlockPair> entries(CURSOR_BATCH);
+    for (int numEntries; (numEntries = cursor.nextN(entries.data(), CURSOR_BATCH)) > 0; ) {
+        for (int i = 0; i < numEntries; i++) {
+            positions.push_back(recordPosition(entries[i].blockId, entries[i].slot));
         }
     }
+    cursor.printStatistics(output);
+    sort(positions.begin(), positions.end());
+    RoaringBitmap numVotesMatches;
+    for (unsigned int position : positions) {
+        numVotesMatches.add(position);
+    }
 
-    return nullptr;
+    RoaringBitmap matches = RoaringBitmap::andOf(ratingIndex->findRatings(averageRatingStart, averageRatingEnd), numVotesMatches);
+    unsigned long numOfRecords = matches.cardinality();
+    for (int tenths = 0; tenths < BitmapIndex::NUM_RATINGS; tenths++) {
+        float averageRating = tenths / 10.0f;
+        if (averageRating >= averageRatingStart && averageRating <= averageRatingEnd) {
+            sumOfAverageRating += matches.andCardinality(ratingIndex->bitmaps[tenths]) * (double) averageRating;
+        }
+    }
+
+    // Ratings without a bitmap are checked in their data blocks, unless no rating of the block is in range
+    void* lastBlockAddress = nullptr;
+    for (unsigned int position : RoaringBitmap::andOf(ratingIndex->otherRatings, numVotesMatches).toVector()) {
+        if (!zoneMap->mayContainAverageRating(position / MAX_RECORDS, averageRatingStart, averageRatingEnd)) continue;
+        void* blockAddress = disk->fetchBlockAddress(position / MAX_RECORDS);
+        if (blockAddress != lastBlockAddress) numOfBlockAccessed++;
+        lastBlockAddress = blockAddress;
+
+        void* block = pinBlockForReading(blockAddress);
+        float averageRating = readAverageRating(block, position % MAX_RECORDS);
+        if (averageRating >= averageRatingStart && averageRating <= averageRatingEnd) {
+            sumOfAverageRating += averageRating;
+            numOfRecords++;
+        }
+        unpinBlockForReading(blockAddress, block);
+    }
+    return numOfRecords;
+}
+
+// Position of a record in the bitmap index, every data block has MAX_RECORDS consecutive positions
+unsigned int DBMS::recordPosition(int blockId, int slot){
+    return (unsigned int) blockId * MAX_RECORDS + slot;
+}
+
+//Reads the averageRating of the records of a group of B+ Tree entries that all point into the same data block,
+//pinning the block once for all of them, used by findRecords()
+//Returns the number of records still in the block, or -1 if the block was released and not read
+int DBMS::retrieveBlockRecords(pointerBlockPair* first, pointerBlockPair* last, float &sumOfAverageRating){
+    // a block released after its last record was deleted still holds that record on disk
+    if (disk->isBlockUnused(first->blockId)) return -1;
+    void* blockAddress = disk->fetchBlockAddress(first->blockId);
+
+    int numOfRecordsFound = 0;
+    void* block = pinBlockForReading(blockAddress);
+    for (pointerBlockPair* entry = first; entry != last; entry++) {
+        int position = findRecordPosition(block, entry->slot, entry->recordID);
+        if (position != -1) {
+            sumOfAverageRating += readAverageRating(block, position);
+            numOfRecordsFound++;
+        }
+    }
+    unpinBlockForReading(blockAddress, block);
+    return numOfRecordsFound;
+}
+
+//Pins a data block that is only read, if every frame is pinned the block is read on disk instead
+//pinBlock() only fails for a block that is not cached, so the pool holds no newer copy of it
+void* DBMS::pinBlockForReading(void* blockAddress){
+    void* block = bufferPool->pinBlock(blockAddress);
+    return block != nullptr ? block : blockAddress;
+}
+
+//Releases a block returned by pinBlockForReading(), block is its frame or the block itself if it was read on disk
+void DBMS::unpinBlockForReading(void* blockAddress, void* block){
+    if (block != blockAddress) {
+        bufferPool->unpinBlock(blockAddress, false);
+    }
+}
+
+//Builds the B+ Tree leaf entry for a record, including its averageRating if the index is covering
+//and the rating can be kept exactly in tenths
+pointerBlockPair DBMS::makeIndexEntry(int blockId, unsigned int recordID, int slot, float averageRating){
+    pointerBlockPair entry = {blockId, (int) recordID, (unsigned short) slot, RATING_NOT_INCLUDED};
+    long ratingTenths = lround(averageRating * 10);
+    if (COVERING_INDEX && ratingTenths >= 0 && ratingTenths < RATING_NOT_INCLUDED && ratingTenths / 10.0f == averageRating) {
+        entry.averageRatingTenths = ratingTenths;
+    }
+    return entry;
+}
+
+//Finds the position of a record within a data block that has already been pinned, or -1 if it is not there
+//The slot is the record's position, recordID only confirms the slot still holds that record
+int DBMS::findRecordPosition(void* blockToRetrieve, unsigned short slot, int recordID){
+
+    unsigned int* presence = presenceBitmap(blockToRetrieve);
+
+    if (slot >= MAX_RECORDS || ((presence[slot / 32] >> (slot % 32)) & 1) == 0) return -1;
+    if (readRecordID(blockToRetrieve, slot) != (unsigned int) recordID) return -1;
+
+    return slot;
 } 
 
-//Prints tconst values of records within data block, used for reporting statistics for experiments
-void DBMS::printDataBlock(void* block, ofstream &output) {
+//Row layout: records are stored from the bottom of the block, position 0 being the last record slot
+//PAX layout: each attribute is read from or written to its minipage
+//Compact records are only decoded attribute by attribute as they are read
+void DBMS::readRecord(void* block, int position, movieRecord &record){
+    if (COMPACT_RECORDS) {
+        record.recordID = readRecordID(block, position);
+        readTconst(block, position, record.tconst);
+        record.averageRating = (*ratingAndVotesOf(block, position) >> COMPACT_VOTES_BITS) / 10.0f;
+        record.numVotes = *ratingAndVotesOf(block, position) & COMPACT_VOTES_MASK;
+        return;
+    }
+    if (LAYOUT == PAX_LAYOUT) {
+        record.recordID = ((unsigned int*)((char*)block + RECORD_ID_OFFSET))[position];
+        record.averageRating = ((float*)((char*)block + AVERAGE_RATING_OFFSET))[position];
+        record.numVotes = ((unsigned int*)((char*)block + NUM_VOTES_OFFSET))[position];
+        memcpy(record.tconst, (char*)block + TCONST_OFFSET + position * sizeof(record.tconst), sizeof(record.tconst));
+        return;
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    record = *(tail - position);
+}
+
+void DBMS::writeRecord(void* block, int position, movieRecord &record){
+    if (COMPACT_RECORDS && LAYOUT == PAX_LAYOUT) {
+        ((unsigned int*)((char*)block + RECORD_ID_OFFSET))[position] = record.recordID;
+    } else if (COMPACT_RECORDS) {
+        compactRecord* tail = (compactRecord*)((char*)block + BLOCK_SIZE - sizeof(compactRecord));
+        (tail - position)->recordID = record.recordID;
+    }
+    if (COMPACT_RECORDS) {
+        *compactTconstOf(block, position) = strtoul(record.tconst + 2, nullptr, 10);
+        *ratingAndVotesOf(block, position) = ((unsigned int)lround(record.averageRating * 10) << COMPACT_VOTES_BITS) | record.numVotes;
+        return;
+    }
+    if (LAYOUT == PAX_LAYOUT) {
+        ((unsigned int*)((char*)block + RECORD_ID_OFFSET))[position] = record.recordID;
+        ((float*)((char*)block + AVERAGE_RATING_OFFSET))[position] = record.averageRating;
+        ((unsigned int*)((char*)block + NUM_VOTES_OFFSET))[position] = record.numVotes;
+        memcpy((char*)block + TCONST_OFFSET + position * sizeof(record.tconst), record.tconst, sizeof(record.tconst));
+        return;
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    *(tail - position) = record;
+}
 
-    int numRecords = *((unsigned int*) block);
+unsigned int DBMS::readNumVotes(void* block, int position){
+    if (COMPACT_RECORDS) {
+        return *ratingAndVotesOf(block, position) & COMPACT_VOTES_MASK;
+    }
+    if (LAYOUT == PAX_LAYOUT) {
+        return ((unsigned int*)((char*)block + NUM_VOTES_OFFSET))[position];
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    return (tail - position)->numVotes;
+}
+
+float DBMS::readAverageRating(void* block, int position){
+    if (COMPACT_RECORDS) {
+        return (*ratingAndVotesOf(block, position) >> COMPACT_VOTES_BITS) / 10.0f;
+    }
+    if (LAYOUT == PAX_LAYOUT) {
+        return ((float*)((char*)block + AVERAGE_RATING_OFFSET))[position];
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    return (tail - position)->averageRating;
+}
 
-    indexMapping* indexMappingTable = (indexMapping*)(((unsigned int*)block) + 1); // Pointer to start of indexMapping table, starts directly after numRecords
-    movieRecord* tail = (movieRecord*)((char*) block + BLOCK_SIZE - sizeof(movieRecord)); // Pointer to start of record slot at bottom of the block
+unsigned int DBMS::readRecordID(void* block, int position){
+    if (LAYOUT == PAX_LAYOUT) {
+        return ((unsigned int*)((char*)block + RECORD_ID_OFFSET))[position];
+    }
+    if (COMPACT_RECORDS) {
+        compactRecord* tail = (compactRecord*)((char*)block + BLOCK_SIZE - sizeof(compactRecord));
+        return (tail - position)->recordID;
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    return (tail - position)->recordID;
+}
+
+//tconst must have room for sizeof(movieRecord::tconst) characters
+void DBMS::readTconst(void* block, int position, char* tconst){
+    if (COMPACT_RECORDS) {
+        snprintf(tconst, sizeof(movieRecord::tconst), "tt%07u", *compactTconstOf(block, position));
+        return;
+    }
+    if (LAYOUT == PAX_LAYOUT) {
+        memcpy(tconst, (char*)block + TCONST_OFFSET + position * sizeof(movieRecord::tconst), sizeof(movieRecord::tconst));
+        return;
+    }
+    movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+    memcpy(tconst, (tail - position)->tconst, sizeof(movieRecord::tconst));
+}
+
+//The presence bitmap starts directly after the header
+unsigned int* DBMS::presenceBitmap(void* block){
+    return (unsigned int*)((dataBlockHeader*)block + 1);
+}
+
+//Locate the attributes of a compact record, from the bottom of the block for row layout or in their minipages for PAX layout
+unsigned int* DBMS::ratingAndVotesOf(void* block, int position){
+    if (LAYOUT == PAX_LAYOUT) {
+        return (unsigned int*)((char*)block + NUM_VOTES_OFFSET) + position;
+    }
+    compactRecord* tail = (compactRecord*)((char*)block + BLOCK_SIZE - sizeof(compactRecord));
+    return &(tail - position)->ratingAndVotes;
+}
+
+unsigned int* DBMS::compactTconstOf(void* block, int position){
+    if (LAYOUT == PAX_LAYOUT) {
+        return (unsigned int*)((char*)block + TCONST_OFFSET) + position;
+    }
+    compactRecord* tail = (compactRecord*)((char*)block + BLOCK_SIZE - sizeof(compactRecord));
+    return &(tail - position)->tconst;
+}
+
+//Checks that a record comes back unchanged from the compact encoding:
+//a "tt" tconst whose digits fit in 32 bits and print back the same, a rating from 0.0 to 10.0 in steps of 0.1
+//and a numVotes that fits in COMPACT_VOTES_BITS bits
+bool DBMS::canEncode(movieRecord &record){
+    if (strncmp(record.tconst, "tt", 2) != 0) return false;
+    char* digitsEnd;
+    unsigned long digits = strtoul(record.tconst + 2, &digitsEnd, 10);
+    char decodedTconst[sizeof(movieRecord::tconst)];
+    snprintf(decodedTconst, sizeof(decodedTconst), "tt%07lu", digits);
+    if (*digitsEnd != '\0' || digits > 0xFFFFFFFFul || strcmp(decodedTconst, record.tconst) != 0) return false;
+
+    long ratingTenths = lround(record.averageRating * 10);
+    if (ratingTenths < 0 || ratingTenths > 100 || ratingTenths / 10.0f != record.averageRating) return false;
+
+    return record.numVotes <= COMPACT_VOTES_MASK;
+}
+
+//Filters the records of a pinned data block on a numVotes range with the scan kernel, returns the number of matches
+//and adds their averageRating to sumOfAverageRating, if matchingRecords is set the location of every match is appended to it
+//Only the numVotes and averageRating attributes are read, each word of the presence bitmap is the live mask of 32 slots
+int DBMS::filterBlock(void* block, void* blockAddress, unsigned int numVotesStart, unsigned int numVotesEnd,
+    double &sumOfAverageRating, list<pointerBlockPair>* matchingRecords){
+
+    unsigned int* presence = presenceBitmap(block);
+
+    const char* numVotes;
+    const char* averageRatings;
+    int stride;
+    if (COMPACT_RECORDS) {
+        numVotes = averageRatings = (char*)ratingAndVotesOf(block, 0);
+        stride = LAYOUT == PAX_LAYOUT ? (int)sizeof(unsigned int) : -(int)sizeof(compactRecord);
+    } else if (LAYOUT == PAX_LAYOUT) {
+        numVotes = (char*)block + NUM_VOTES_OFFSET;
+        averageRatings = (char*)block + AVERAGE_RATING_OFFSET;
+        stride = sizeof(unsigned int);
+    } else {
+        movieRecord* tail = (movieRecord*)((char*)block + BLOCK_SIZE - sizeof(movieRecord));
+        numVotes = (char*)&tail->numVotes;
+        averageRatings = (char*)&tail->averageRating;
+        stride = -(int)sizeof(movieRecord);
+    }
+
+    int numMatches = 0;
+    for (int first = 0; first < MAX_RECORDS; first += ScanKernel::MAX_RECORDS_PER_CALL) {
+        unsigned int liveMask = presence[first / 32];
+        if (liveMask == 0) continue;
+        int numInCall = min(MAX_RECORDS - first, ScanKernel::MAX_RECORDS_PER_CALL);
+
+        unsigned int matches;
+        if (COMPACT_RECORDS) {
+            matches = scanKernel->filterPacked(numVotes + (long)first * stride, stride,
+                numInCall, liveMask, numVotesStart, numVotesEnd, sumOfAverageRating);
+        } else {
+            matches = scanKernel->filter(numVotes + (long)first * stride, averageRatings + (long)first * stride, stride,
+                numInCall, liveMask, numVotesStart, numVotesEnd, sumOfAverageRating);
+        }
+        numMatches += __builtin_popcount(matches);
+
+        for (; matchingRecords != nullptr && matches != 0; matches &= matches - 1) {
+            int slot = first + __builtin_ctz(matches);
+            matchingRecords->push_back({disk->getBlockId(blockAddress), (int) readRecordID(block, slot), (unsigned short) slot, RATING_NOT_INCLUDED});
+        }
+    }
+    return numMatches;
+}
+
+//Recomputes the zone map entry of a pinned data block from the records left in it
+void DBMS::rebuildZone(int blockId, void* block){
+    unsigned int* presence = presenceBitmap(block);
+    zoneMap->resetBlock(blockId);
+    for (int word = 0; word < PRESENCE_WORDS; word++) {
+        for (unsigned int bits = presence[word]; bits != 0; bits &= bits - 1) {
+            int slot = word * 32 + __builtin_ctz(bits);
+            zoneMap->addRecord(blockId, readNumVotes(block, slot), readAverageRating(block, slot));
+        }
+    }
+}
+
+//Scans every data block with SCAN_THREADS threads, returns the number of records with numVotesStart <= numVotes <= numVotesEnd
+//and adds their averageRating to sumOfAverageRating, if matchingRecords is set the location of every match is appended to it
+//Threads repeatedly take the next SCAN_CHUNK_BLOCKS blocks until none are left, so a thread that is slowed down
+//(e.g. waiting on disk reads) simply ends up scanning fewer chunks
+//Each thread keeps its own count, sum and matches, which are merged once all threads are done
+//The dirty blocks in the buffer pool are written back first and the threads then read the blocks directly from disk,
+//so that a full scan does not evict every cached block
+//Blocks whose zone map range does not overlap the numVotes range are skipped without being read
+int DBMS::scanDataBlocks(unsigned int numVotesStart, unsigned int numVotesEnd, int &numOfBlockAccessed, int &numOfBlockSkipped,
+    double &sumOfAverageRating, list<pointerBlockPair>* matchingRecords){
+
+    bufferPool->flushAll();
+
+    // Data blocks are split extent by extent, in the order they sit on disk
+    vector<int> dataBlockIds;
+    for (int blockId : disk->getSegmentBlockIds(dataSegment)) {
+        if (zoneMap->mayContainNumVotes(blockId, numVotesStart, numVotesEnd)) {
+            dataBlockIds.push_back(blockId);
+        } else {
+            numOfBlockSkipped++;
+        }
+    }
+    int numBlocksToScan = dataBlockIds.size();
+    int numChunks = (numBlocksToScan + SCAN_CHUNK_BLOCKS - 1) / SCAN_CHUNK_BLOCKS;
+    int numThreads = max(1, min(SCAN_THREADS, numChunks));
+
+    // each on its own cache line, as every thread updates its partial for every block
+    struct alignas(64) scanPartial
+    {
+        int numMatches;
+        double sumOfAverageRating;
+        list<pointerBlockPair> matchingRecords;
+    };
+    vector<scanPartial> partials(numThreads, {0, 0, {}});
+    atomic<int> nextChunk(0);
+
+    auto scanChunks = [&](int threadId) {
+        scanPartial &partial = partials[threadId];
+        list<pointerBlockPair>* matches = matchingRecords == nullptr ? nullptr : &partial.matchingRecords;
+        for (int chunk = nextChunk.fetch_add(1); chunk < numChunks; chunk = nextChunk.fetch_add(1)) {
+            int first = chunk * SCAN_CHUNK_BLOCKS;
+            int last = min(first + SCAN_CHUNK_BLOCKS, numBlocksToScan);
+            for (int i = first; i < min(first + PREFETCH_DEPTH, last); i++) {
+                disk->prefetchBlock(disk->fetchBlockAddress(dataBlockIds[i]));
+            }
+            for (int i = first; i < last; i++) {
+                if (i + PREFETCH_DEPTH < last) {
+                    disk->prefetchBlock(disk->fetchBlockAddress(dataBlockIds[i + PREFETCH_DEPTH]));
+                }
+                void* block = disk->fetchBlockAddress(dataBlockIds[i]);
+                partial.numMatches += filterBlock(block, block, numVotesStart, numVotesEnd, partial.sumOfAverageRating, matches);
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int threadId = 1; threadId < numThreads; threadId++) {
+        threads.push_back(thread(scanChunks, threadId));
+    }
+    scanChunks(0); // the calling thread scans too
+    for (thread &t : threads) {
+        t.join();
+    }
+
+    int numMatches = 0;
+    for (scanPartial &partial : partials) {
+        numMatches += partial.numMatches;
+        sumOfAverageRating += partial.sumOfAverageRating;
+        if (matchingRecords != nullptr) {
+            matchingRecords->splice(matchingRecords->end(), partial.matchingRecords);
+        }
+    }
+    numOfBlockAccessed += numBlocksToScan;
+    return numMatches;
+}
+
+//Prints tconst values of records within data block, used for reporting statistics for experiments
+void DBMS::printDataBlock(void* blockAddress, ofstream &output) {
+
+    void* block = pinBlockForReading(blockAddress);
+    unsigned int* presence = presenceBitmap(block);
 
     cout << " | ";
     char toPrint[24];
+    char tconst[sizeof(movieRecord::tconst)];
     for (int i=0; i<MAX_RECORDS; i++) {
-        if (i < numRecords) {
-            snprintf(toPrint, 24, "%12s | ", (tail-i)->tconst);
+        if ((presence[i / 32] >> (i % 32)) & 1) {
+            readTconst(block, i, tconst);
+            snprintf(toPrint, 24, "%12s | ", tconst);
         } else {
             snprintf(toPrint, 24, "%12s | ", "            ");
         }
@@ -246,6 +905,7 @@ void DBMS::printDataBlock(void* block, ofstream &output) {
     }
     cout << "\n";
     output << "\n";
+    unpinBlockForReading(blockAddress, block);
 }
 
 // Deletes records with a certain number of votes and updates the B+ Tree
@@ -259,6 +919,7 @@ void DBMS::deleteRecord(unsigned int numVotes, ofstream &output)
     chrono::system_clock::time_point start, end;
     start = chrono::system_clock::now();
 
+    bufferPool->resetStatistics();
     list<pointerBlockPair> recordsToDelete = bPlusTree->findRecord(numVotes, numVotes, dummy);
     int numOfBlockAccessed = 0;
     
@@ -276,8 +937,7 @@ void DBMS::deleteRecord(unsigned int numVotes, ofstream &output)
 
     //Updating B+ Tree after deletion
     printf("Updating B+ Tree Index...\n");
-    void* nodeToDeleteFrom = bPlusTree->findNode(numVotes, bPlusTree->root, 0, dummy, true);
-    bPlusTree->deleteKey(numVotes, nodeToDeleteFrom);
+    bPlusTree->removeKey(numVotes);
     
     printf("B+ Tree Index successfully updated!\n");
 
@@ -285,32 +945,26 @@ void DBMS::deleteRecord(unsigned int numVotes, ofstream &output)
     output << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
     cout << "The number of data blocks accessed if B+ Tree is used: " << numOfBlockAccessed << "\n";
     cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
+    bufferPool->printStatistics(output);
 }
 
 void DBMS::deleteRecordBF(unsigned int numVotes, ofstream &output){
     printf("Deleting record from disk in a brute-force linear scan...\n");
 
     int numOfBlockAccessed = 0;
-    set<void*> accessedBlocks; 
+    int numOfBlockSkipped = 0;
     list<pointerBlockPair> recordsToDelete;
 
     // clock starts
     chrono::system_clock::time_point start, end;
     start = chrono::system_clock::now();
 
-    // make a list of pointers of delete records
-    for(int blockID=0;blockID<numBlocks;blockID++){
-        numOfBlockAccessed++;
-        void* blockPtr = (void*)((char*)this->initialBlockPtr + blockID * BLOCK_SIZE);
-
-        for(int recID=1;recID<=MAX_RECORDS;recID++){
-            pointerBlockPair recordLocation = {blockPtr, recID + blockID * MAX_RECORDS};
-            movieRecord* record = retrieveRecord(recordLocation, accessedBlocks);
-            if(record==nullptr) break;
-            if(record->numVotes==numVotes)
-                recordsToDelete.push_back(recordLocation);
-        }
-    }
+    bufferPool->resetStatistics();
+
+    // make a list of pointers of delete records with a parallel scan, then delete them one by one,
+    // since deleting changes the blocks, the free space map and the buffer pool
+    double unusedSum = 0;
+    scanDataBlocks(numVotes, numVotes, numOfBlockAccessed, numOfBlockSkipped, unusedSum, &recordsToDelete);
     for (pointerBlockPair recordToDelete: recordsToDelete)
         deleteRecordFunc(recordToDelete);
 
@@ -320,35 +974,60 @@ void DBMS::deleteRecordBF(unsigned int numVotes, ofstream &output){
 
     printf("Record(s) successfully deleted from disk!\n");
 
+    // A covering index and the rating bitmaps combined with B+ Tree ranges answer queries without visiting the data blocks,
+    // so the B+ Tree must not keep entries for the deleted records
+    if (!recordsToDelete.empty()) {
+        printf("Updating B+ Tree Index...\n");
+        bPlusTree->removeKey(numVotes);
+        printf("B+ Tree Index successfully updated!\n");
+    }
+
     output << "The number of data blocks accessed if a brute-force linear scan is used: " << numOfBlockAccessed << "\n";
+    output << "The number of data blocks skipped using zone maps: " << numOfBlockSkipped << "\n";
     output << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
     cout << "The number of data blocks accessed if a brute-force linear scan is used: " << numOfBlockAccessed << "\n";
+    cout << "The number of data blocks skipped using zone maps: " << numOfBlockSkipped << "\n";
     cout << "The running time of the retrieval process (measured by chrono::system_clock) =  " << elapsed / 1000 <<  " ms" << "\n";
+    bufferPool->printStatistics(output);
 }
 
 void DBMS::deleteRecordFunc(pointerBlockPair recordToDelete){
-    void* blockToRetrieve = recordToDelete.blockAddress;
-    unsigned int* numOfRecords = (unsigned int*)blockToRetrieve;
-    indexMapping* indexMappingTable = (indexMapping*)(numOfRecords + 1);
-    for (int i = 0; i <= *numOfRecords; i++){
-        if (indexMappingTable->recordID == recordToDelete.recordID){
-            //Set gravestone and decrement number of records in block
-            indexMappingTable->indexOfRecord = -1;
-            indexMappingTable->recordID = 0;
-            (*numOfRecords)--;
-            
-            //Iterate through list of free blocks, if not previously inside, then add it in
-            list<void*>::iterator iter = find(freeBlocks.begin(), freeBlocks.end(), recordToDelete.blockAddress);
-            if (*iter != recordToDelete.blockAddress){ //Previously full block, now can accommodate record, add to freeBlocks
-                freeBlocks.push_front(recordToDelete.blockAddress);
-            } 
-            // Update map table to indicate block is free if there are no records inside anymore
-            else if (*numOfRecords == 0) { 
-                disk->updateMapTable(blockToRetrieve);
-            }
-            break;
-        } else {
-            indexMappingTable++;
+    if (disk->isBlockUnused(recordToDelete.blockId)) return; // already deleted along with its block
+    void* blockToRetrieve = disk->fetchBlockAddress(recordToDelete.blockId);
+    void* block = bufferPool->pinBlock(blockToRetrieve);
+    if (block == nullptr) {
+        printf("Buffer pool is full, record %d cannot be deleted!\n", recordToDelete.recordID);
+        return;
+    }
+    dataBlockHeader* header = (dataBlockHeader*)block;
+    int slot = findRecordPosition(block, recordToDelete.slot, recordToDelete.recordID);
+    if (slot != -1){
+        int blockId = recordToDelete.blockId;
+        bool shrinksZone = zoneMap->isOnEdge(blockId, readNumVotes(block, slot), readAverageRating(block, slot));
+        char tconst[11];
+        readTconst(block, slot, tconst);
+        hashIndex->deleteEntry(tconst, blockId, slot);
+        ratingIndex->removeRecord(recordPosition(blockId, slot), readAverageRating(block, slot));
+
+        //Clear the record's presence bit and decrement number of records in block
+        presenceBitmap(block)[slot / 32] &= ~(1u << (slot % 32));
+        header->numRecords--;
+
+        // Update map table to indicate block is free if there are no records inside anymore
+        if (header->numRecords == 0) {
+            freeSpaceMap->removeBlock(blockId);
+            zoneMap->resetBlock(blockId);
+            bufferPool->unpinBlock(blockToRetrieve, true);
+            bufferPool->discardBlock(blockToRetrieve);
+            disk->updateMapTable(blockToRetrieve);
+            numBlocks--;
+            return;
+        }
+        // Block now has room for one more record
+        freeSpaceMap->updateBlock(blockId, MAX_RECORDS - header->numRecords);
+        if (shrinksZone) {
+            rebuildZone(blockId, block);
         }
-    }    
+    }
+    bufferPool->unpinBlock(blockToRetrieve, true);
 }
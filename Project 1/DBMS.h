@@ -4,7 +4,14 @@
 #include <algorithm>
 #include <set>
 #include "DiskSimulator.h"
+#include "BufferPool.h"
+#include "FreeSpaceMap.h"
+#include "ScanKernel.h"
+#include "ZoneMap.h"
+#include "HashIndex.h"
+#include "BitmapIndex.h"
 #include "BPlusTree.h"
+#include "BPlusTreeCursor.h"
 #include "structures.h"
 #include <string>
 #include <fstream>
@@ -18,24 +25,88 @@ class DBMS
     int DISK_SIZE; // calculated in MB
     int BLOCK_SIZE; // calculated in B
     int MAX_RECORDS; // maximum number of movieRecords for a block
+    int PREFETCH_DEPTH; // number of data blocks read ahead of the one being processed
+    int CURSOR_BATCH; // number of B+ Tree entries taken from a range cursor at a time
+    int SCAN_THREADS; // number of threads the brute-force scans are split across
+    int SCAN_CHUNK_BLOCKS; // number of data blocks a scan thread takes at a time
+    blockLayout LAYOUT; // row-wise or PAX data blocks
+    bool COMPACT_RECORDS; // records are stored as compactRecords
+    bool COVERING_INDEX; // leaf entries of the B+ Tree include averageRating
+    bool CLUSTERED; // data blocks hold records in numVotes order
+    int CLUSTERED_FILL; // number of records importData() puts in a clustered data block, the rest is slack for later inserts
+    float INDEX_FILL_FACTOR; // fraction of the keys of a B+ Tree node filled when the tree is bulk loaded
+    int RECORD_SIZE; // bytes taken by the attributes of a record in a data block
+    int PRESENCE_WORDS; // number of 32-bit words in the presence bitmap of a data block
+    // Offsets of the minipages from the start of a PAX data block
+    // For compact records, AVERAGE_RATING_OFFSET and NUM_VOTES_OFFSET are both the ratingAndVotes minipage, TCONST_OFFSET an integer minipage
+    int RECORD_ID_OFFSET;
+    int AVERAGE_RATING_OFFSET;
+    int NUM_VOTES_OFFSET;
+    int TCONST_OFFSET;
     int numRecords; // total number of records
     int numBlocks;
 
-    list<void*> freeBlocks; // Allows for tracking of blocks that can still accomodate additional records
+    FreeSpaceMap* freeSpaceMap; // Allows for tracking of blocks that can still accomodate additional records
+    ZoneMap* zoneMap; // numVotes and averageRating range of every data block, lets scans skip blocks
     BPlusTree* bPlusTree;
     DiskSimulator* disk; 
-    void* initialBlockPtr;
+    BufferPool* bufferPool; // all reads and writes of data blocks, hash buckets and B+ Tree nodes go through the buffer pool
+    int dataSegment; // disk segment whose extents hold the data blocks
+    HashIndex* hashIndex; // tconst to record location, for point lookups by tconst
+    int hashIndexSegment; // disk segment whose extents hold the buckets of the hash index
+    int indexSegment; // disk segment whose extents hold the nodes of the B+ Tree
+    BitmapIndex* ratingIndex; // averageRating bitmaps over record positions, combined with B+ Tree ranges by AND
+    ScanKernel* scanKernel; // vectorized filter used by the brute-force scans
+    vector<pair<unsigned int, pointerBlockPair>> bulkLoadRecords; // B+ Tree entries of the records bulk loaded so far
+    int bulkLoadBlockId; // data block the last bulk loaded record went to
 
     //Initialisation functions
-    DBMS(unsigned int diskSize, unsigned int blockSize);
+    // diskFile set to use a file-backed disk, bufferFrames is the number of blocks the buffer pool can hold
+    // layout and compactRecords decide how records are stored in data blocks, a reopened disk must use the ones it was loaded with
+    // coveringIndex includes averageRating in the B+ Tree so averages over a numVotes range are answered from the index alone
+    // clustered keeps the data blocks in numVotes order, so a range query reads a few neighbouring blocks
+    // indexFillFactor is the fraction of every B+ Tree node filled when the tree is bulk loaded,
+    // including on reopening a disk whose tree was not closed by its last run
+    DBMS(unsigned int diskSize, unsigned int blockSize, const char* diskFile = nullptr, unsigned int bufferFrames = 1024,
+        blockLayout layout = ROW_LAYOUT, bool compactRecords = false, bool coveringIndex = false, bool clustered = false,
+        float indexFillFactor = 1.0);
     ~DBMS();
 
+    void loadFromDisk();
     void importData(std::string tsv_file);
     void findRecords(unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output);
     void findRecordsBF(unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output);
-    movieRecord* retrieveRecord(pointerBlockPair recordToRetrieve, set<void*> &accessedBlocks);
+    void findRecordByTconst(const char* tconst, ofstream &output);
+    void findRecordsByRating(float averageRatingStart, float averageRatingEnd, unsigned int numVotesStart, unsigned int numVotesEnd, ofstream &output);
+    unsigned long matchRatingAndNumVotes(float averageRatingStart, float averageRatingEnd, unsigned int numVotesStart, unsigned int numVotesEnd,
+        double &sumOfAverageRating, int &numOfBlockAccessed, ofstream &output);
+    unsigned int recordPosition(int blockId, int slot);
+    int retrieveBlockRecords(pointerBlockPair* first, pointerBlockPair* last, float &sumOfAverageRating);
+    int findRecordPosition(void* block, unsigned short slot, int recordID);
+    void* pinBlockForReading(void* blockAddress);
+    void unpinBlockForReading(void* blockAddress, void* block);
+    pointerBlockPair makeIndexEntry(int blockId, unsigned int recordID, int slot, float averageRating);
+
+    //Access to the attributes of the record at a position within a pinned data block, for either layout
+    void readRecord(void* block, int position, movieRecord &record);
+    void writeRecord(void* block, int position, movieRecord &record);
+    unsigned int readNumVotes(void* block, int position);
+    float readAverageRating(void* block, int position);
+    unsigned int readRecordID(void* block, int position);
+    void readTconst(void* block, int position, char* tconst);
+    unsigned int* presenceBitmap(void* block);
+    unsigned int* ratingAndVotesOf(void* block, int position);
+    unsigned int* compactTconstOf(void* block, int position);
+    bool canEncode(movieRecord &record);
+    int filterBlock(void* block, void* blockAddress, unsigned int numVotesStart, unsigned int numVotesEnd,
+        double &sumOfAverageRating, list<pointerBlockPair>* matchingRecords);
+    int scanDataBlocks(unsigned int numVotesStart, unsigned int numVotesEnd, int &numOfBlockAccessed, int &numOfBlockSkipped,
+        double &sumOfAverageRating, list<pointerBlockPair>* matchingRecords);
+    void rebuildZone(int blockId, void* block);
     movieRecord* retrieveRecordBF(list<void*> &accessedBlocks);
-    void insertRecord(movieRecord toInsert);
+    bool insertRecord(movieRecord toInsert, bool isBulkLoad = false);
+    int findClusteredBlock(unsigned int numVotes, int maxRecordsInBlock);
+    void finishBulkLoad();
     void deleteRecord(unsigned int numVotes, ofstream &output);
     void deleteRecordBF(unsigned int numVotes, ofstream &output);
     void deleteRecordFunc(pointerBlockPair recordToDelete);
@@ -1,35 +1,289 @@
 #include "DiskSimulator.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char DISK_FILE_MAGIC[8] = {'S','C','3','0','2','0','D','K'};
 
 DiskSimulator::DiskSimulator(int size, int sizeOfBlock)
 {
     blockSize = sizeOfBlock;
-    disk = malloc(size*1000000);
+    disk = malloc((size_t)size*1000000);
+    diskFd = -1;
+    mappedSize = 0;
+    isReopened = false;
+    fileHeader = nullptr;
+
+    // Initialise freeBitmap - i.e. split disk into blocks, all of which start off unused
+    numOfBlocks = ((size_t)size*1000000) / sizeOfBlock;
+    numOfBitmapWords = (numOfBlocks + 63) / 64;
+    numOfExtents = numOfBitmapWords;
+    freeBitmap = (uint64_t*)malloc(numOfBitmapWords * sizeof(uint64_t));
+    extentOwner = (unsigned char*)malloc(numOfExtents);
+    initialiseMapTable();
+}
+
+DiskSimulator::DiskSimulator(int size, int sizeOfBlock, const char* diskFile)
+{
+    blockSize = sizeOfBlock;
+    numOfBlocks = ((size_t)size*1000000) / sizeOfBlock;
+    numOfBitmapWords = (numOfBlocks + 63) / 64;
+    numOfExtents = numOfBitmapWords;
+    isReopened = false;
+    fileHeader = nullptr;
+
+#ifdef _WIN32
+    printf("File-backed disks are not supported on this platform, using an in-memory disk instead\n");
+    disk = malloc((size_t)size*1000000);
+    diskFd = -1;
+    mappedSize = 0;
+    freeBitmap = (uint64_t*)malloc(numOfBitmapWords * sizeof(uint64_t));
+    extentOwner = (unsigned char*)malloc(numOfExtents);
+    initialiseMapTable();
+#else
+    // File layout: [block 0 ... block n-1][diskFileHeader][freeBitmap][extentOwner]
+    size_t blocksSize = (size_t)numOfBlocks * blockSize;
+    mappedSize = blocksSize + sizeof(diskFileHeader) + numOfBitmapWords * sizeof(uint64_t) + numOfExtents;
+
+    diskFd = open(diskFile, O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (diskFd == -1 || fstat(diskFd, &fileStat) == -1) {
+        perror(diskFile);
+        exit(1);
+    }
+    bool fileHasDisk = (size_t)fileStat.st_size == mappedSize;
+    if (!fileHasDisk && ftruncate(diskFd, mappedSize) == -1) {
+        perror(diskFile);
+        exit(1);
+    }
+
+    disk = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, diskFd, 0);
+    if (disk == MAP_FAILED) {
+        perror(diskFile);
+        exit(1);
+    }
+
+    diskFileHeader* header = (diskFileHeader*)((char*)disk + blocksSize);
+    freeBitmap = (uint64_t*)(header + 1);
+    extentOwner = (unsigned char*)(freeBitmap + numOfBitmapWords);
+    fileHeader = header;
+
+    // Reuse the blocks already in the file only if it was written with the same geometry
+    if (fileHasDisk && memcmp(header->magic, DISK_FILE_MAGIC, sizeof(DISK_FILE_MAGIC)) == 0
+        && header->blockSize == blockSize && header->numOfBlocks == numOfBlocks) {
+        isReopened = true;
+        numOfUnusedBlocks = 0;
+        for (int i = 0; i < numOfBitmapWords; i++) {
+            numOfUnusedBlocks += __builtin_popcountll(freeBitmap[i]);
+        }
+        loadSegmentExtents();
+    } else {
+        if (fileStat.st_size != 0) {
+            printf("%s does not hold a disk of %dMB with %dB blocks, formatting it\n", diskFile, size, sizeOfBlock);
+        }
+        memcpy(header->magic, DISK_FILE_MAGIC, sizeof(DISK_FILE_MAGIC));
+        header->blockSize = blockSize;
+        header->numOfBlocks = numOfBlocks;
+        header->layout = 0;
+        header->isCompact = 0;
+        initialiseMapTable();
+    }
+#endif
+}
+
+DiskSimulator::~DiskSimulator()
+{
+#ifndef _WIN32
+    if (diskFd != -1) {
+        flush();
+        munmap(disk, mappedSize);
+        close(diskFd);
+        return;
+    }
+#endif
+    free(extentOwner);
+    free(freeBitmap);
+    free(disk);
+}
+
+// Marks every block as unused
+void DiskSimulator::initialiseMapTable()
+{
+    numOfUnusedBlocks = numOfBlocks;
+    memset(freeBitmap, 0xFF, numOfBitmapWords * sizeof(uint64_t));
+
+    // Bits past the last block in the final word are marked as in use so they are never handed out
+    if (numOfBlocks % 64 != 0) {
+        freeBitmap[numOfBitmapWords-1] = (1ULL << (numOfBlocks % 64)) - 1;
+    }
+
+    memset(extentOwner, 0, numOfExtents);
+    loadSegmentExtents();
+}
+
+// Rebuilds the extent list of every segment from extentOwner
+// Segments are numbered in creation order, so segmentExtents is prepared for every segment id found
+// and createSegment() hands the same ids out again when the segments are recreated after reopening
+void DiskSimulator::loadSegmentExtents()
+{
+    numOfSegments = 0;
+    nextFreeExtent = numOfExtents;
+    segmentExtents.assign(1, vector<int>()); // segment id 0 means an extent is not owned
+    for (int extentId = 0; extentId < numOfExtents; extentId++) {
+        int owner = extentOwner[extentId];
+        if (owner == 0) {
+            if (extentId < nextFreeExtent) nextFreeExtent = extentId;
+            continue;
+        }
+        if (owner >= (int)segmentExtents.size()) segmentExtents.resize(owner + 1);
+        segmentExtents[owner].push_back(extentId);
+    }
+    segmentNextExtent.assign(segmentExtents.size(), 0);
+}
+
+//Creates a new segment with no extents yet, segment ids start from 1
+int DiskSimulator::createSegment()
+{
+    if (numOfSegments == 255) {
+        printf("Cannot create more than 255 segments on a disk!\n");
+        return -1;
+    }
+    numOfSegments++;
+    if (numOfSegments >= (int)segmentExtents.size()) {
+        segmentExtents.resize(numOfSegments + 1);
+        segmentNextExtent.resize(numOfSegments + 1, 0);
+    }
+    return numOfSegments;
+}
 
-    // Initialise mapTable - i.e. split disk into blocks
-    numOfBlocks = (size*1000000) / sizeOfBlock;
-    int i;
-    for (i=0; i<numOfBlocks; i++)
-    {
-        // Add offset to disk's base address to get this block's address
-        void* blockAddress = reinterpret_cast<void*>(reinterpret_cast<char*>(disk) + i*sizeOfBlock);
-        mapTable[blockAddress] = true;
-        emptyBlocks.push_back(blockAddress);
+//Gives the lowest free extent to a segment, returns its id or -1 if every extent is owned
+int DiskSimulator::claimExtent(int segmentId)
+{
+    while (nextFreeExtent < numOfExtents && extentOwner[nextFreeExtent] != 0) {
+        nextFreeExtent++;
+    }
+    if (nextFreeExtent == numOfExtents) {
+        return -1;
     }
+
+    // Extents are claimed in ascending order, so the segment's extent list stays sorted
+    int extentId = nextFreeExtent;
+    extentOwner[extentId] = segmentId;
+    segmentExtents[segmentId].push_back(extentId);
+    return extentId;
 }
 
-//Toggles whether block is in use or not 
+//Toggles whether block is in use or not
 void DiskSimulator::updateMapTable(void* blockAddr)
 {
-    mapTable[blockAddr] = !mapTable[blockAddr];
-    if (mapTable[blockAddr]) { // block is now unused
-        emptyBlocks.push_back(blockAddr);
+    int blockId = getBlockId(blockAddr);
+    int extentId = blockId / BLOCKS_PER_EXTENT;
+    freeBitmap[extentId] ^= (1ULL << (blockId % BLOCKS_PER_EXTENT));
+
+    if (isBlockUnused(blockId)) { // block is now unused
+        numOfUnusedBlocks++;
+
+        // The extent stays with its segment, which may now find a free block in it earlier than before
+        int segmentId = extentOwner[extentId];
+        vector<int>& extents = segmentExtents[segmentId];
+        int extentIndex = lower_bound(extents.begin(), extents.end(), extentId) - extents.begin();
+        if (extentIndex < segmentNextExtent[segmentId]) segmentNextExtent[segmentId] = extentIndex;
+    } else {
+        numOfUnusedBlocks--;
+    }
+}
+
+//Returns the address of a block from its id, blocks are laid out back to back from the disk's base address
+void* DiskSimulator::fetchBlockAddress(int blockId)
+{
+    return reinterpret_cast<void*>(reinterpret_cast<char*>(disk) + (size_t)blockId*blockSize);
+}
+
+//Returns the id of the block at blockAddr, the inverse of fetchBlockAddress()
+int DiskSimulator::getBlockId(void* blockAddr)
+{
+    return (reinterpret_cast<char*>(blockAddr) - reinterpret_cast<char*>(disk)) / blockSize;
+}
+
+bool DiskSimulator::isBlockUnused(int blockId)
+{
+    return (freeBitmap[blockId / 64] >> (blockId % 64)) & 1;
+}
+
+//Returns the address of the lowest numbered unused block within the extents of a segment,
+//claiming a new extent for the segment if all of its extents are full, or nullptr if the disk is full
+//The block is not claimed until updateMapTable() is called on it
+void* DiskSimulator::getUnusedBlock(int segmentId)
+{
+    vector<int>& extents = segmentExtents[segmentId];
+    int& extentIndex = segmentNextExtent[segmentId];
+
+    // Skip over full extents, each is a single bitmap word
+    while (extentIndex < (int)extents.size() && freeBitmap[extents[extentIndex]] == 0) {
+        extentIndex++;
+    }
+    if (extentIndex == (int)extents.size() && claimExtent(segmentId) == -1) {
+        return nullptr;
+    }
+
+    int extentId = extents[extentIndex];
+    int blockId = extentId*BLOCKS_PER_EXTENT + __builtin_ctzll(freeBitmap[extentId]);
+    return fetchBlockAddress(blockId);
+}
+
+//Returns the ids of the blocks in use in a segment's extents, in ascending order
+//Used to scan a segment sequentially without assuming its blocks are back to back
+vector<int> DiskSimulator::getSegmentBlockIds(int segmentId)
+{
+    vector<int> blockIds;
+    for (int extentId : segmentExtents[segmentId]) {
+        uint64_t usedBlocks = ~freeBitmap[extentId];
+        if (extentId == numOfExtents - 1 && numOfBlocks % BLOCKS_PER_EXTENT != 0) {
+            usedBlocks &= (1ULL << (numOfBlocks % BLOCKS_PER_EXTENT)) - 1; // past the last block
+        }
+        while (usedBlocks != 0) {
+            blockIds.push_back(extentId*BLOCKS_PER_EXTENT + __builtin_ctzll(usedBlocks));
+            usedBlocks &= usedBlocks - 1;
+        }
     }
+    return blockIds;
 }
 
-//Returns the address of the first free block in the list of free blocks remaining and pop it
-void* DiskSimulator::getUnusedBlock()
+//Issues an asynchronous read of a block
+//For a file-backed disk the OS is asked to start reading the block's pages from the file without waiting for them,
+//for an in-memory disk the block is only prefetched into the CPU cache
+//Safe to call from several scanning threads at once
+void DiskSimulator::prefetchBlock(void* blockAddr)
 {
-    void* blockAddr = emptyBlocks.front();
-    emptyBlocks.pop_front();
-    return blockAddr;
-}
\ No newline at end of file
+#ifndef _WIN32
+    if (diskFd != -1) {
+        // avoids asking the OS to read ahead the same page again for neighbouring blocks
+        static thread_local char* lastPrefetchedPage = nullptr;
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        char* firstPage = (char*)((uintptr_t)blockAddr & ~(pageSize - 1));
+        char* lastPage = (char*)(((uintptr_t)blockAddr + blockSize - 1) & ~(pageSize - 1));
+        if (firstPage == lastPrefetchedPage && lastPage == lastPrefetchedPage) return;
+
+        posix_madvise(firstPage, lastPage - firstPage + pageSize, POSIX_MADV_WILLNEED);
+        lastPrefetchedPage = lastPage;
+        return;
+    }
+#endif
+    for (int offset = 0; offset < blockSize; offset += 64) {
+        __builtin_prefetch((char*)blockAddr + offset);
+    }
+}
+
+//Writes all modified blocks of a file-backed disk to its file, does nothing for an in-memory disk
+void DiskSimulator::flush()
+{
+#ifndef _WIN32
+    if (diskFd != -1) {
+        msync(disk, mappedSize, MS_SYNC);
+    }
+#endif
+}
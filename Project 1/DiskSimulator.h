@@ -1,30 +1,93 @@
+#ifndef DISKSIMULATOR_H
+#define DISKSIMULATOR_H
+
 #include <utility>
-#include <unordered_map>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
-#include <list>
+#include <cstdint>
+#include <vector>
 
 using namespace std;
 
+// Blocks are handed out in extents of this many contiguous blocks, one word of freeBitmap per extent
+const int BLOCKS_PER_EXTENT = 64;
+
+// Stored after the last block of a file-backed disk, used to recognise a disk file on reopening
+struct diskFileHeader
+{
+    char magic[8];
+    int blockSize;
+    int numOfBlocks;
+    int layout;     // blockLayout of the data blocks, set by the DBMS when the file is created
+    int isCompact;  // 1 if the records are in the compact encoding, set along with layout
+};
+
 class DiskSimulator
 {
     public:
     void* disk;     // holds disk's base address
-    int blockSize;  
+    int blockSize;
     int numOfBlocks;
-    list<void*> emptyBlocks;
-    unordered_map<void*, bool> mapTable;    // mapTable keeps track for each block, if it is not in use
-    
+    int numOfUnusedBlocks;
+    uint64_t* freeBitmap;   // one bit per block, bit i of word w is set if block (w*64 + i) is not in use
+    int numOfBitmapWords;
+
+    // Extents, word w of freeBitmap describes the blocks of extent w
+    // Each segment (e.g. a table) owns a set of extents and only allocates blocks from them,
+    // so the blocks of a segment stay together on disk no matter how other segments allocate and free blocks
+    int numOfExtents;
+    unsigned char* extentOwner;         // segment id owning each extent, 0 if the extent is free
+    int nextFreeExtent;                 // every extent before this one is owned, so scanning for a free extent starts here
+    int numOfSegments;
+    vector<vector<int>> segmentExtents; // extent ids owned by each segment, in ascending order
+    vector<int> segmentNextExtent;      // index into segmentExtents of the first extent that may have a free block
+
+    // File-backed mode
+    int diskFd;             // -1 if the disk lives in memory only
+    size_t mappedSize;      // size of the whole mapping: blocks, diskFileHeader and freeBitmap
+    bool isReopened;        // true if an existing disk file was mapped in with its blocks intact
+    diskFileHeader* fileHeader; // header of the disk file, nullptr for an in-memory disk
+
     // Constructs a new disk of {size}MB and splits the disk into multiple blocks of {sizeOfBlock}B each
     DiskSimulator(int size, int sizeOfBlock);
-    
+
+    // Constructs a disk of {size}MB backed by the file {diskFile}, memory mapped with the same block layout
+    // If {diskFile} already holds a disk with the same geometry, its blocks and map table are reused
+    DiskSimulator(int size, int sizeOfBlock, const char* diskFile);
+    ~DiskSimulator();
+
     // function to set a block as empty or non-empty
     void updateMapTable(void* blockAddr);
 
     // function to return a block's address
     void* fetchBlockAddress(int blockId);
 
-    // function to get an unused block
-    void* getUnusedBlock();
-};
\ No newline at end of file
+    // function to return the id of the block at an address
+    int getBlockId(void* blockAddr);
+
+    // function to check if a block is not in use
+    bool isBlockUnused(int blockId);
+
+    // function to create a new segment, returns its id
+    int createSegment();
+
+    // function to get an unused block of a segment
+    void* getUnusedBlock(int segmentId);
+
+    // function to get the ids of the blocks in use by a segment, in ascending order
+    vector<int> getSegmentBlockIds(int segmentId);
+
+    // function to start reading a block in the background, so a later access to it does not wait
+    void prefetchBlock(void* blockAddr);
+
+    // function to write the blocks of a file-backed disk back to its file
+    void flush();
+
+    private:
+    void initialiseMapTable();
+    void loadSegmentExtents();
+    int claimExtent(int segmentId);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "FreeSpaceMap.h"
+
+FreeSpaceMap::FreeSpaceMap(int maxRecords)
+{
+    this->maxRecords = maxRecords;
+    buckets.resize(maxRecords + 1);
+    nonEmptyBuckets.assign(maxRecords / 64 + 1, 0);
+}
+
+// Moves a block to the bucket for its new number of free slots
+void FreeSpaceMap::updateBlock(int blockId, int numFreeSlots)
+{
+    if (blockId >= (int)bucketOfBlock.size()) {
+        bucketOfBlock.resize(blockId + 1, 0);
+        positionInBucket.resize(blockId + 1, 0);
+    }
+    if (bucketOfBlock[blockId] == numFreeSlots) return;
+
+    removeBlock(blockId);
+    if (numFreeSlots == 0) return; // full blocks are not tracked
+
+    bucketOfBlock[blockId] = numFreeSlots;
+    positionInBucket[blockId] = buckets[numFreeSlots].size();
+    buckets[numFreeSlots].push_back(blockId);
+    nonEmptyBuckets[numFreeSlots / 64] |= 1ULL << (numFreeSlots % 64);
+}
+
+// Removes a block from its bucket by moving the last block of the bucket into its place
+void FreeSpaceMap::removeBlock(int blockId)
+{
+    if (blockId >= (int)bucketOfBlock.size() || bucketOfBlock[blockId] == 0) return;
+
+    int bucket = bucketOfBlock[blockId];
+    int position = positionInBucket[blockId];
+    int lastBlockId = buckets[bucket].back();
+    buckets[bucket][position] = lastBlockId;
+    positionInBucket[lastBlockId] = position;
+    buckets[bucket].pop_back();
+
+    if (buckets[bucket].empty()) {
+        nonEmptyBuckets[bucket / 64] &= ~(1ULL << (bucket % 64));
+    }
+    bucketOfBlock[blockId] = 0;
+}
+
+int FreeSpaceMap::numFreeSlots(int blockId)
+{
+    if (blockId < 0 || blockId >= (int)bucketOfBlock.size()) return 0;
+    return bucketOfBlock[blockId];
+}
+
+// Filling the fullest blocks first keeps the number of partially filled blocks low
+int FreeSpaceMap::findBlockWithSpace()
+{
+    for (int word = 0; word < (int)nonEmptyBuckets.size(); word++) {
+        if (nonEmptyBuckets[word] != 0) {
+            int bucket = word * 64 + __builtin_ctzll(nonEmptyBuckets[word]);
+            return buckets[bucket].back();
+        }
+    }
+    return -1;
+}
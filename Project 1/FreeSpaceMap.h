@@ -0,0 +1,33 @@
+#ifndef FREESPACEMAP_H
+#define FREESPACEMAP_H
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Tracks the data blocks that can still accomodate additional records
+// Blocks are kept in buckets by their number of free slots, so both finding a block with room
+// and moving a block to another bucket after an insert or delete take constant time
+class FreeSpaceMap
+{
+    public:
+    int maxRecords;
+    vector<vector<int>> buckets;        // buckets[k] holds the ids of the blocks with exactly k free slots, k >= 1
+    vector<uint64_t> nonEmptyBuckets;   // bit k is set if buckets[k] is not empty
+    vector<int> bucketOfBlock;          // bucket each block is in, indexed by block id, 0 if the block is full or untracked
+    vector<int> positionInBucket;       // index of each block within its bucket, indexed by block id
+
+    FreeSpaceMap(int maxRecords);
+
+    // Records that a block now has numFreeSlots free slots, a full block (0 free slots) is no longer tracked
+    void updateBlock(int blockId, int numFreeSlots);
+    // Stops tracking a block, e.g. when it is released back to the disk
+    void removeBlock(int blockId);
+    // Returns the number of free slots of a block, 0 if it is full or untracked
+    int numFreeSlots(int blockId);
+    // Returns the block with room for a record that has the fewest free slots, or -1 if every block is full
+    int findBlockWithSpace();
+};
+
+#endif
@@ -0,0 +1,322 @@
+#include "HashIndex.h"
+#include <algorithm>
+#include <cstring>
+
+static const char HASH_MAGIC[8] = "HASHIX1";
+
+HashIndex::HashIndex(DiskSimulator* disk, BufferPool* bufferPool, int segmentId)
+{
+    this->disk = disk;
+    this->bufferPool = bufferPool;
+    this->segmentId = segmentId;
+    maxEntries = (disk->blockSize - sizeof(hashBucketHeader)) / sizeof(hashIndexEntry);
+    globalDepth = 0;
+    numBuckets = 0;
+    numOverflowBlocks = 0;
+    numBlocksAccessed = 0;
+
+    // The header block is the first block of the segment, the buckets of a reopened disk are used as they are
+    // only if its last run closed the index, they are read before anything is pinned
+    vector<int> blockIds = disk->getSegmentBlockIds(segmentId);
+    hashIndexHeader* header = blockIds.empty() ? nullptr : (hashIndexHeader*) disk->fetchBlockAddress(blockIds[0]);
+    isLoaded = header != nullptr && memcmp(header->magic, HASH_MAGIC, sizeof(HASH_MAGIC)) == 0 && header->isClosed;
+    if (isLoaded) {
+        headerId = blockIds[0];
+        loadDirectory(blockIds);
+        // written straight to disk, so that the index is rebuilt if this run ends without closing it
+        header->isClosed = 0;
+        return;
+    }
+
+    // Buckets left by a run that did not close the index may be stale or partly written,
+    // so they are released and DBMS::loadFromDisk() inserts the entries again
+    for (int blockId : blockIds) {
+        bufferPool->discardBlock(disk->fetchBlockAddress(blockId));
+        disk->updateMapTable(disk->fetchBlockAddress(blockId));
+    }
+    void* headerAddress = disk->getUnusedBlock(segmentId);
+    if (headerAddress == nullptr) {
+        printf("Disk is full, the tconst hash index cannot be created!\n");
+        exit(1);
+    }
+    disk->updateMapTable(headerAddress);
+    headerId = disk->getBlockId(headerAddress);
+    header = (hashIndexHeader*) pinNewBucket(headerAddress);
+    memcpy(header->magic, HASH_MAGIC, sizeof(HASH_MAGIC));
+    header->isClosed = 0;
+    bufferPool->unpinBlock(headerAddress, true);
+
+    // a single bucket for every key to start with
+    directory.assign(1, getNewBucketBlock(0, 0, false));
+}
+
+// Marks the index as closed in its header block, the buffer pool writes it back when it is deleted
+HashIndex::~HashIndex()
+{
+    void* headerAddress = disk->fetchBlockAddress(headerId);
+    hashIndexHeader* header = (hashIndexHeader*) pinBucket(headerAddress);
+    header->isClosed = 1;
+    bufferPool->unpinBlock(headerAddress, true);
+}
+
+// Pins a block of the index, a full buffer pool leaves the index unusable
+void* HashIndex::pinBucket(void* blockAddress)
+{
+    void* bucket = bufferPool->pinBlock(blockAddress);
+    if (bucket == nullptr) {
+        printf("Buffer pool is full, the tconst hash index cannot read a bucket!\n");
+        exit(1);
+    }
+    return bucket;
+}
+
+// Pins a block just taken from the index segment, which is not read from disk
+void* HashIndex::pinNewBucket(void* blockAddress)
+{
+    void* bucket = bufferPool->pinNewBlock(blockAddress);
+    if (bucket == nullptr) {
+        printf("Buffer pool is full, the tconst hash index cannot grow!\n");
+        exit(1);
+    }
+    return bucket;
+}
+
+// FNV-1a followed by the MurmurHash3 finalizer, so that the low bits used by the directory depend on every character
+// The hash is stored on disk, so it must not change between runs
+unsigned int HashIndex::hashTconst(const char* tconst)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < 11 && tconst[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)tconst[i]) * 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Rebuilds the directory from the bucket blocks of a reopened disk
+// Every first bucket block records the hash bits it holds, it is pointed to by every directory slot ending in them
+void HashIndex::loadDirectory(vector<int> &blockIds)
+{
+    blockIds.erase(remove(blockIds.begin(), blockIds.end(), headerId), blockIds.end());
+    for (int blockId : blockIds) {
+        hashBucketHeader* header = (hashBucketHeader*)disk->fetchBlockAddress(blockId);
+        if (header->isOverflow) {
+            numOverflowBlocks++;
+            continue;
+        }
+        numBuckets++;
+        globalDepth = max(globalDepth, (int)header->localDepth);
+    }
+    if (numBuckets == 0) return;
+
+    directory.assign(1u << globalDepth, -1);
+    for (int blockId : blockIds) {
+        hashBucketHeader* header = (hashBucketHeader*)disk->fetchBlockAddress(blockId);
+        if (header->isOverflow) continue;
+        for (unsigned int i = header->hashBits; i < directory.size(); i += 1u << header->localDepth) {
+            directory[i] = blockId;
+        }
+    }
+}
+
+// Gets a new block for a bucket from the index segment and initialises its header
+int HashIndex::getNewBucketBlock(unsigned int localDepth, unsigned int hashBits, bool isOverflow)
+{
+    void* blockAddress = disk->getUnusedBlock(segmentId);
+    if (blockAddress == nullptr) {
+        printf("Disk is full, the tconst hash index cannot grow!\n");
+        exit(1);
+    }
+    disk->updateMapTable(blockAddress);
+    isOverflow ? numOverflowBlocks++ : numBuckets++;
+
+    hashBucketHeader* header = (hashBucketHeader*)pinNewBucket(blockAddress);
+    header->numEntries = 0;
+    header->localDepth = localDepth;
+    header->isOverflow = isOverflow;
+    header->hashBits = hashBits;
+    header->nextBlockId = -1;
+    bufferPool->unpinBlock(blockAddress, true);
+    return disk->getBlockId(blockAddress);
+}
+
+// Releases an overflow block that a split emptied
+void HashIndex::releaseBlock(int blockId)
+{
+    void* blockAddress = disk->fetchBlockAddress(blockId);
+    bufferPool->discardBlock(blockAddress);
+    disk->updateMapTable(blockAddress);
+    numOverflowBlocks--;
+}
+
+hashIndexEntry* HashIndex::entriesOf(void* bucket)
+{
+    return (hashIndexEntry*)((hashBucketHeader*)bucket + 1);
+}
+
+// Returns true if every entry of a bucket and its overflow blocks has the given hash, i.e. splitting cannot separate them
+bool HashIndex::hasOnlyHash(int blockId, unsigned int tconstHash)
+{
+    bool isOnlyHash = true;
+    while (blockId != -1 && isOnlyHash) {
+        void* blockAddress = disk->fetchBlockAddress(blockId);
+        void* bucket = pinBucket(blockAddress);
+        hashBucketHeader* header = (hashBucketHeader*)bucket;
+        hashIndexEntry* entries = entriesOf(bucket);
+        for (unsigned int i = 0; i < header->numEntries; i++) {
+            if (entries[i].tconstHash != tconstHash) {
+                isOnlyHash = false;
+                break;
+            }
+        }
+        int nextBlockId = header->nextBlockId;
+        bufferPool->unpinBlock(blockAddress, false);
+        blockId = nextBlockId;
+    }
+    return isOnlyHash;
+}
+
+// Adds an entry to the first block of a bucket with room, adding an overflow block at the end if they are all full
+void HashIndex::appendToBucket(int blockId, hashIndexEntry entry)
+{
+    while (true) {
+        void* blockAddress = disk->fetchBlockAddress(blockId);
+        void* bucket = pinBucket(blockAddress);
+        hashBucketHeader* header = (hashBucketHeader*)bucket;
+        if (header->numEntries < (unsigned int)maxEntries) {
+            entriesOf(bucket)[header->numEntries++] = entry;
+            bufferPool->unpinBlock(blockAddress, true);
+            return;
+        }
+        if (header->nextBlockId == -1) {
+            header->nextBlockId = getNewBucketBlock(header->localDepth, header->hashBits, true);
+        }
+        int nextBlockId = header->nextBlockId;
+        bufferPool->unpinBlock(blockAddress, true);
+        blockId = nextBlockId;
+    }
+}
+
+// Splits a bucket on its next hash bit: the keys with that bit set move to a new bucket
+// The directory is doubled first if the bucket already uses globalDepth bits
+void HashIndex::splitBucket(int blockId)
+{
+    vector<hashIndexEntry> entries;
+    void* blockAddress = disk->fetchBlockAddress(blockId);
+    void* bucket = pinBucket(blockAddress);
+    hashBucketHeader* header = (hashBucketHeader*)bucket;
+    unsigned int localDepth = header->localDepth;
+    unsigned int hashBits = header->hashBits;
+
+    // Take every entry out of the bucket and release its overflow blocks
+    entries.insert(entries.end(), entriesOf(bucket), entriesOf(bucket) + header->numEntries);
+    int overflowBlockId = header->nextBlockId;
+    header->numEntries = 0;
+    header->localDepth = localDepth + 1;
+    header->nextBlockId = -1;
+    bufferPool->unpinBlock(blockAddress, true);
+    while (overflowBlockId != -1) {
+        void* overflowAddress = disk->fetchBlockAddress(overflowBlockId);
+        void* overflow = pinBucket(overflowAddress);
+        hashBucketHeader* overflowHeader = (hashBucketHeader*)overflow;
+        entries.insert(entries.end(), entriesOf(overflow), entriesOf(overflow) + overflowHeader->numEntries);
+        int nextBlockId = overflowHeader->nextBlockId;
+        bufferPool->unpinBlock(overflowAddress, false);
+        releaseBlock(overflowBlockId);
+        overflowBlockId = nextBlockId;
+    }
+
+    if ((int)localDepth == globalDepth) {
+        directory.insert(directory.end(), directory.begin(), directory.end());
+        globalDepth++;
+    }
+
+    // Directory slots ending in the new bit set now point to the new bucket
+    unsigned int newHashBits = hashBits | (1u << localDepth);
+    int newBlockId = getNewBucketBlock(localDepth + 1, newHashBits, false);
+    for (unsigned int i = newHashBits; i < directory.size(); i += 1u << (localDepth + 1)) {
+        directory[i] = newBlockId;
+    }
+
+    for (hashIndexEntry &entry : entries) {
+        appendToBucket((entry.tconstHash >> localDepth) & 1 ? newBlockId : blockId, entry);
+    }
+}
+
+// Inserts the entry of a record into the bucket of its tconst, splitting full buckets until it fits
+void HashIndex::insertEntry(const char* tconst, hashIndexEntry entry)
+{
+    entry.tconstHash = hashTconst(tconst);
+    while (true) {
+        int blockId = directory[entry.tconstHash & ((1u << globalDepth) - 1)];
+        void* blockAddress = disk->fetchBlockAddress(blockId);
+        void* bucket = pinBucket(blockAddress);
+        hashBucketHeader* header = (hashBucketHeader*)bucket;
+        if (header->numEntries < (unsigned int)maxEntries) {
+            entriesOf(bucket)[header->numEntries++] = entry;
+            bufferPool->unpinBlock(blockAddress, true);
+            return;
+        }
+        int localDepth = header->localDepth;
+        bufferPool->unpinBlock(blockAddress, false);
+
+        if (localDepth == MAX_GLOBAL_DEPTH || hasOnlyHash(blockId, entry.tconstHash)) {
+            appendToBucket(blockId, entry);
+            return;
+        }
+        splitBucket(blockId);
+    }
+}
+
+// Reads the bucket of tconst and its overflow blocks, if any
+vector<hashIndexEntry> HashIndex::findEntries(const char* tconst)
+{
+    vector<hashIndexEntry> results;
+    unsigned int tconstHash = hashTconst(tconst);
+    numBlocksAccessed = 0;
+
+    int blockId = directory[tconstHash & ((1u << globalDepth) - 1)];
+    while (blockId != -1) {
+        numBlocksAccessed++;
+        void* blockAddress = disk->fetchBlockAddress(blockId);
+        void* bucket = pinBucket(blockAddress);
+        hashBucketHeader* header = (hashBucketHeader*)bucket;
+        hashIndexEntry* entries = entriesOf(bucket);
+        for (unsigned int i = 0; i < header->numEntries; i++) {
+            if (entries[i].tconstHash == tconstHash) {
+                results.push_back(entries[i]);
+            }
+        }
+        int nextBlockId = header->nextBlockId;
+        bufferPool->unpinBlock(blockAddress, false);
+        blockId = nextBlockId;
+    }
+    return results;
+}
+
+// The last entry of the block takes the place of the deleted one
+void HashIndex::deleteEntry(const char* tconst, int blockId, unsigned int slot)
+{
+    unsigned int tconstHash = hashTconst(tconst);
+    int bucketBlockId = directory[tconstHash & ((1u << globalDepth) - 1)];
+    while (bucketBlockId != -1) {
+        void* blockAddress = disk->fetchBlockAddress(bucketBlockId);
+        void* bucket = pinBucket(blockAddress);
+        hashBucketHeader* header = (hashBucketHeader*)bucket;
+        hashIndexEntry* entries = entriesOf(bucket);
+        for (unsigned int i = 0; i < header->numEntries; i++) {
+            if (entries[i].blockId == blockId && entries[i].slot == slot) {
+                entries[i] = entries[--header->numEntries];
+                bufferPool->unpinBlock(blockAddress, true);
+                return;
+            }
+        }
+        int nextBlockId = header->nextBlockId;
+        bufferPool->unpinBlock(blockAddress, false);
+        bucketBlockId = nextBlockId;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <vector>
+#include "DiskSimulator.h"
+#include "BufferPool.h"
+#include "structures.h"
+
+using namespace std;
+
+// Extendible hash index on tconst, mapping each tconst to the location of its record
+// The buckets are disk blocks of their own segment, read and written through the buffer pool,
+// only the directory (one bucket block id per combination of the globalDepth lowest hash bits) is kept in memory
+// A full bucket is split in two on one more hash bit, doubling the directory when the bucket already used all of them,
+// so a lookup reads a single bucket block unless the bucket has overflow blocks
+class HashIndex
+{
+    public:
+    // Buckets are not split past this many hash bits, they get overflow blocks instead
+    static constexpr int MAX_GLOBAL_DEPTH = 24;
+
+    DiskSimulator* disk;
+    BufferPool* bufferPool;
+    int segmentId;          // disk segment whose extents hold the bucket blocks
+    int headerId;           // block of the segment holding the hashIndexHeader, before every bucket block
+    int maxEntries;         // number of hashIndexEntries that fit in a bucket block
+    int globalDepth;
+    vector<int> directory;  // bucket block id for every value of the globalDepth lowest hash bits
+    bool isLoaded;          // true if the buckets were found on a reopened disk whose last run closed the index
+
+    //For Experiments
+    int numBuckets;
+    int numOverflowBlocks;
+    int numBlocksAccessed;  // bucket blocks read by the last findEntries()
+
+    HashIndex(DiskSimulator* disk, BufferPool* bufferPool, int segmentId);
+    ~HashIndex();
+
+    static unsigned int hashTconst(const char* tconst);
+
+    void insertEntry(const char* tconst, hashIndexEntry entry);
+    // Returns the entries whose hash matches tconst, the records they point to still have to be checked for tconst itself
+    vector<hashIndexEntry> findEntries(const char* tconst);
+    // Removes the entry of the record at (blockId, slot), buckets are never merged back
+    void deleteEntry(const char* tconst, int blockId, unsigned int slot);
+
+    private:
+    void loadDirectory(vector<int> &blockIds);
+    void* pinBucket(void* blockAddress);
+    void* pinNewBucket(void* blockAddress);
+    int getNewBucketBlock(unsigned int localDepth, unsigned int hashBits, bool isOverflow);
+    void releaseBlock(int blockId);
+    hashIndexEntry* entriesOf(void* bucket);
+    bool hasOnlyHash(int blockId, unsigned int tconstHash);
+    void appendToBucket(int blockId, hashIndexEntry entry);
+    void splitBucket(int blockId);
+};
+
+#endif
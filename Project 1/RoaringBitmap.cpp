@@ -0,0 +1,265 @@
+#include "RoaringBitmap.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+// Returns the index of the container with the given key, or -1 if there is none
+int RoaringBitmap::findContainer(unsigned short key) const
+{
+    vector<roaringContainer>::const_iterator it = lower_bound(containers.begin(), containers.end(), key,
+        [](const roaringContainer &container, unsigned short key) { return container.key < key; });
+    if (it == containers.end() || it->key != key) return -1;
+    return it - containers.begin();
+}
+
+void RoaringBitmap::toBitmap(roaringContainer &container)
+{
+    container.words.assign(1024, 0);
+    for (unsigned short low : container.values) {
+        container.words[low / 64] |= 1ULL << (low % 64);
+    }
+    container.values.clear();
+    container.values.shrink_to_fit();
+    container.isBitmap = true;
+}
+
+void RoaringBitmap::toArray(roaringContainer &container)
+{
+    container.values.clear();
+    for (int word = 0; word < 1024; word++) {
+        for (uint64_t bits = container.words[word]; bits != 0; bits &= bits - 1) {
+            container.values.push_back(word * 64 + __builtin_ctzll(bits));
+        }
+    }
+    container.words.clear();
+    container.words.shrink_to_fit();
+    container.isBitmap = false;
+}
+
+void RoaringBitmap::add(unsigned int value)
+{
+    unsigned short key = value >> 16;
+    unsigned short low = value & 0xFFFF;
+
+    vector<roaringContainer>::iterator it = lower_bound(containers.begin(), containers.end(), key,
+        [](const roaringContainer &container, unsigned short key) { return container.key < key; });
+    if (it == containers.end() || it->key != key) {
+        it = containers.insert(it, roaringContainer{key, false, 0, {}, {}});
+    }
+    roaringContainer &container = *it;
+
+    if (container.isBitmap) {
+        uint64_t bit = 1ULL << (low % 64);
+        if ((container.words[low / 64] & bit) == 0) {
+            container.words[low / 64] |= bit;
+            container.cardinality++;
+        }
+        return;
+    }
+    // values usually arrive in ascending order, so the end of the array is checked first
+    vector<unsigned short>::iterator position = container.values.end();
+    if (!container.values.empty() && container.values.back() >= low) {
+        position = lower_bound(container.values.begin(), container.values.end(), low);
+        if (*position == low) return;
+    }
+    container.values.insert(position, low);
+    container.cardinality++;
+    if (container.cardinality > ARRAY_MAX) toBitmap(container);
+}
+
+void RoaringBitmap::remove(unsigned int value)
+{
+    int index = findContainer(value >> 16);
+    if (index == -1) return;
+    roaringContainer &container = containers[index];
+    unsigned short low = value & 0xFFFF;
+
+    if (container.isBitmap) {
+        uint64_t bit = 1ULL << (low % 64);
+        if ((container.words[low / 64] & bit) == 0) return;
+        container.words[low / 64] &= ~bit;
+        container.cardinality--;
+        if (container.cardinality <= ARRAY_MIN) toArray(container);
+    } else {
+        vector<unsigned short>::iterator position = lower_bound(container.values.begin(), container.values.end(), low);
+        if (position == container.values.end() || *position != low) return;
+        container.values.erase(position);
+        container.cardinality--;
+    }
+    if (container.cardinality == 0) {
+        containers.erase(containers.begin() + index);
+    }
+}
+
+bool RoaringBitmap::contains(unsigned int value)
+{
+    int index = findContainer(value >> 16);
+    if (index == -1) return false;
+    roaringContainer &container = containers[index];
+    unsigned short low = value & 0xFFFF;
+
+    if (container.isBitmap) {
+        return (container.words[low / 64] >> (low % 64)) & 1;
+    }
+    return binary_search(container.values.begin(), container.values.end(), low);
+}
+
+unsigned long RoaringBitmap::cardinality()
+{
+    unsigned long total = 0;
+    for (roaringContainer &container : containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+vector<unsigned int> RoaringBitmap::toVector()
+{
+    vector<unsigned int> result;
+    for (roaringContainer &container : containers) {
+        unsigned int high = (unsigned int)container.key << 16;
+        if (!container.isBitmap) {
+            for (unsigned short low : container.values) result.push_back(high | low);
+            continue;
+        }
+        for (int word = 0; word < 1024; word++) {
+            for (uint64_t bits = container.words[word]; bits != 0; bits &= bits - 1) {
+                result.push_back(high | (word * 64 + __builtin_ctzll(bits)));
+            }
+        }
+    }
+    return result;
+}
+
+// Array & array merges the sorted values, array & bitmap looks each value up, bitmap & bitmap ANDs the words
+roaringContainer RoaringBitmap::andContainers(const roaringContainer &a, const roaringContainer &b)
+{
+    roaringContainer result = {a.key, false, 0, {}, {}};
+    if (a.isBitmap && b.isBitmap) {
+        result.isBitmap = true;
+        result.words.resize(1024);
+        for (int word = 0; word < 1024; word++) {
+            result.words[word] = a.words[word] & b.words[word];
+            result.cardinality += __builtin_popcountll(result.words[word]);
+        }
+        if (result.cardinality <= ARRAY_MAX) toArray(result);
+    } else if (a.isBitmap || b.isBitmap) {
+        const roaringContainer &array = a.isBitmap ? b : a;
+        const roaringContainer &bitmap = a.isBitmap ? a : b;
+        for (unsigned short low : array.values) {
+            if ((bitmap.words[low / 64] >> (low % 64)) & 1) result.values.push_back(low);
+        }
+        result.cardinality = result.values.size();
+    } else {
+        set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), back_inserter(result.values));
+        result.cardinality = result.values.size();
+    }
+    return result;
+}
+
+roaringContainer RoaringBitmap::orContainers(const roaringContainer &a, const roaringContainer &b)
+{
+    roaringContainer result = {a.key, false, 0, {}, {}};
+    if (!a.isBitmap && !b.isBitmap) {
+        set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), back_inserter(result.values));
+        result.cardinality = result.values.size();
+        if (result.cardinality > ARRAY_MAX) toBitmap(result);
+        return result;
+    }
+
+    // at least one side is a bitmap, so the union has more than ARRAY_MIN values and stays a bitmap
+    result.isBitmap = true;
+    result.words = a.isBitmap ? a.words : b.words;
+    const roaringContainer &other = a.isBitmap ? b : a;
+    if (other.isBitmap) {
+        for (int word = 0; word < 1024; word++) result.words[word] |= other.words[word];
+    } else {
+        for (unsigned short low : other.values) result.words[low / 64] |= 1ULL << (low % 64);
+    }
+    for (int word = 0; word < 1024; word++) {
+        result.cardinality += __builtin_popcountll(result.words[word]);
+    }
+    return result;
+}
+
+unsigned long RoaringBitmap::andContainersCardinality(const roaringContainer &a, const roaringContainer &b)
+{
+    unsigned long count = 0;
+    if (a.isBitmap && b.isBitmap) {
+        for (int word = 0; word < 1024; word++) count += __builtin_popcountll(a.words[word] & b.words[word]);
+    } else if (a.isBitmap || b.isBitmap) {
+        const roaringContainer &array = a.isBitmap ? b : a;
+        const roaringContainer &bitmap = a.isBitmap ? a : b;
+        for (unsigned short low : array.values) count += (bitmap.words[low / 64] >> (low % 64)) & 1;
+    } else {
+        size_t i = 0, j = 0;
+        while (i < a.values.size() && j < b.values.size()) {
+            if (a.values[i] < b.values[j]) {
+                i++;
+            } else if (a.values[i] > b.values[j]) {
+                j++;
+            } else {
+                count++;
+                i++;
+                j++;
+            }
+        }
+    }
+    return count;
+}
+
+// Only containers whose keys appear in both bitmaps can have values in common
+RoaringBitmap RoaringBitmap::andOf(const RoaringBitmap &a, const RoaringBitmap &b)
+{
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.containers.size() && j < b.containers.size()) {
+        if (a.containers[i].key < b.containers[j].key) {
+            i++;
+        } else if (a.containers[i].key > b.containers[j].key) {
+            j++;
+        } else {
+            roaringContainer container = andContainers(a.containers[i], b.containers[j]);
+            if (container.cardinality > 0) result.containers.push_back(move(container));
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::orOf(const RoaringBitmap &a, const RoaringBitmap &b)
+{
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.containers.size() || j < b.containers.size()) {
+        if (j == b.containers.size() || (i < a.containers.size() && a.containers[i].key < b.containers[j].key)) {
+            result.containers.push_back(a.containers[i++]);
+        } else if (i == a.containers.size() || a.containers[i].key > b.containers[j].key) {
+            result.containers.push_back(b.containers[j++]);
+        } else {
+            result.containers.push_back(orContainers(a.containers[i], b.containers[j]));
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+unsigned long RoaringBitmap::andCardinality(const RoaringBitmap &other) const
+{
+    unsigned long count = 0;
+    size_t i = 0, j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        if (containers[i].key < other.containers[j].key) {
+            i++;
+        } else if (containers[i].key > other.containers[j].key) {
+            j++;
+        } else {
+            count += andContainersCardinality(containers[i], other.containers[j]);
+            i++;
+            j++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// One container of a RoaringBitmap, holding the values that share their high 16 bits (key)
+// Up to ARRAY_MAX values are kept as a sorted array of their low 16 bits, more as a bitmap of all 65536 low values
+// A bitmap container only goes back to an array once removals bring it down to ARRAY_MIN values,
+// so adding and removing values around ARRAY_MAX does not convert it every time
+struct roaringContainer
+{
+    unsigned short key;
+    bool isBitmap;
+    int cardinality;
+    vector<unsigned short> values;  // sorted low 16 bits, if !isBitmap
+    vector<uint64_t> words;         // 1024 words of 64 bits, if isBitmap
+};
+
+// Compressed set of 32-bit values in the style of Roaring bitmaps
+// Sparse ranges of values take 2 bytes per value, dense ranges 8kB per 65536 values,
+// and AND/OR are computed container by container with the cheapest method for each pair of container kinds
+class RoaringBitmap
+{
+    public:
+    static constexpr int ARRAY_MAX = 4096; // above this many values a bitmap container is smaller than an array
+    static constexpr int ARRAY_MIN = 2048; // a bitmap container with this many values or fewer is turned back into an array
+
+    vector<roaringContainer> containers; // sorted by key
+
+    void add(unsigned int value);
+    void remove(unsigned int value);
+    bool contains(unsigned int value);
+    unsigned long cardinality();
+    // Returns the values in ascending order
+    vector<unsigned int> toVector();
+
+    static RoaringBitmap andOf(const RoaringBitmap &a, const RoaringBitmap &b);
+    static RoaringBitmap orOf(const RoaringBitmap &a, const RoaringBitmap &b);
+    // Number of values in both bitmaps, without building their intersection
+    unsigned long andCardinality(const RoaringBitmap &other) const;
+
+    private:
+    int findContainer(unsigned short key) const;
+    static void toBitmap(roaringContainer &container);
+    static void toArray(roaringContainer &container);
+    static roaringContainer andContainers(const roaringContainer &a, const roaringContainer &b);
+    static roaringContainer orContainers(const roaringContainer &a, const roaringContainer &b);
+    static unsigned long andContainersCardinality(const roaringContainer &a, const roaringContainer &b);
+};
+
+#endif
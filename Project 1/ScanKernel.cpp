@@ -0,0 +1,179 @@
+#include "ScanKernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// Every implementation is instantiated twice: IS_PACKED reads a compactRecord ratingAndVotes word for both attributes,
+// otherwise numVotes is an unsigned int and averageRating a float
+// Packed ratings are summed as integers (tenths) and only converted once at the end
+
+template <bool IS_PACKED>
+static unsigned int filterScalar(const char* numVotes, const char* averageRatings, int stride, int numRecords,
+    unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating)
+{
+    unsigned int matches = 0;
+    unsigned int sumOfRatingTenths = 0;
+    for (int i = 0; i < numRecords; i++) {
+        unsigned int votes = *(const unsigned int*)(numVotes + (long)i * stride);
+        if (IS_PACKED) votes &= COMPACT_VOTES_MASK;
+        if (((liveMask >> i) & 1) && votes >= numVotesStart && votes <= numVotesEnd) {
+            matches |= 1u << i;
+            if (IS_PACKED) {
+                sumOfRatingTenths += *(const unsigned int*)(averageRatings + (long)i * stride) >> COMPACT_VOTES_BITS;
+            } else {
+                sumOfAverageRating += *(const float*)(averageRatings + (long)i * stride);
+            }
+        }
+    }
+    if (IS_PACKED) sumOfAverageRating += sumOfRatingTenths / 10.0;
+    return matches;
+}
+
+#ifdef SCAN_KERNEL_X86
+
+// 4 records at a time, SSE has no gather so strided values are loaded one by one
+template <bool IS_PACKED>
+__attribute__((target("sse4.1")))
+static unsigned int filterSSE(const char* numVotes, const char* averageRatings, int stride, int numRecords,
+    unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating)
+{
+    const __m128i low = _mm_set1_epi32(numVotesStart);
+    const __m128i high = _mm_set1_epi32(numVotesEnd);
+    const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+    __m128d sum = _mm_setzero_pd();
+    __m128i sumOfRatingTenths = _mm_setzero_si128();
+    unsigned int matches = 0;
+
+    for (int i = 0; i < numRecords; i += 4) {
+        unsigned int lanes[4] = {0, 0, 0, 0};
+        for (int lane = 0; lane < 4 && i + lane < numRecords; lane++) {
+            lanes[lane] = *(const unsigned int*)(numVotes + (long)(i + lane) * stride);
+        }
+        __m128i words = _mm_loadu_si128((const __m128i*)lanes);
+        __m128i votes = IS_PACKED ? _mm_and_si128(words, _mm_set1_epi32(COMPACT_VOTES_MASK)) : words;
+
+        // unsigned range check: start <= votes exactly when max(votes, start) == votes
+        __m128i inRange = _mm_and_si128(_mm_cmpeq_epi32(_mm_max_epu32(votes, low), votes),
+                                        _mm_cmpeq_epi32(_mm_min_epu32(votes, high), votes));
+        unsigned int validLanes = (liveMask >> i) & 0xF;
+        if (numRecords - i < 4) validLanes &= (1u << (numRecords - i)) - 1;
+        unsigned int laneMask = _mm_movemask_ps(_mm_castsi128_ps(inRange)) & validLanes;
+        if (laneMask == 0) continue;
+        matches |= laneMask << i;
+
+        if (IS_PACKED) {
+            // the rating is already in the word that was loaded
+            __m128i sumMask = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(laneMask), laneBits), laneBits);
+            sumOfRatingTenths = _mm_add_epi32(sumOfRatingTenths, _mm_and_si128(_mm_srli_epi32(words, COMPACT_VOTES_BITS), sumMask));
+            continue;
+        }
+
+        // lanes that did not match stay 0 and add nothing to the sum
+        float ratingLanes[4] = {0, 0, 0, 0};
+        for (int lane = 0; lane < 4; lane++) {
+            if ((laneMask >> lane) & 1) ratingLanes[lane] = *(const float*)(averageRatings + (long)(i + lane) * stride);
+        }
+        __m128 ratings = _mm_loadu_ps(ratingLanes);
+        sum = _mm_add_pd(sum, _mm_cvtps_pd(ratings));
+        sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(ratings, ratings)));
+    }
+
+    if (IS_PACKED) {
+        unsigned int tenths[4];
+        _mm_storeu_si128((__m128i*)tenths, sumOfRatingTenths);
+        sumOfAverageRating += (tenths[0] + tenths[1] + tenths[2] + tenths[3]) / 10.0;
+        return matches;
+    }
+    double lanesSum[2];
+    _mm_storeu_pd(lanesSum, sum);
+    sumOfAverageRating += lanesSum[0] + lanesSum[1];
+    return matches;
+}
+
+// 8 records at a time, strided attributes are fetched with masked gathers and contiguous (PAX) ones with masked loads
+template <bool IS_PACKED>
+__attribute__((target("avx2")))
+static unsigned int filterAVX2(const char* numVotes, const char* averageRatings, int stride, int numRecords,
+    unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating)
+{
+    const __m256i low = _mm256_set1_epi32(numVotesStart);
+    const __m256i high = _mm256_set1_epi32(numVotesEnd);
+    const __m256i laneIds = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i laneOffsets = _mm256_mullo_epi32(laneIds, _mm256_set1_epi32(stride));
+    const bool isContiguous = stride == sizeof(unsigned int);
+    __m256d sum = _mm256_setzero_pd();
+    __m256i sumOfRatingTenths = _mm256_setzero_si256();
+    unsigned int matches = 0;
+
+    for (int i = 0; i < numRecords; i += 8) {
+        // lanes past the last record are never read
+        __m256i loadMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(numRecords - i), laneIds);
+        __m256i offsets = _mm256_add_epi32(laneOffsets, _mm256_set1_epi32(i * stride));
+        __m256i words;
+        if (isContiguous) {
+            words = _mm256_maskload_epi32((const int*)numVotes + i, loadMask);
+        } else {
+            words = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)numVotes, offsets, loadMask, 1);
+        }
+        __m256i votes = IS_PACKED ? _mm256_and_si256(words, _mm256_set1_epi32(COMPACT_VOTES_MASK)) : words;
+
+        __m256i inRange = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(votes, low), votes),
+                                           _mm256_cmpeq_epi32(_mm256_min_epu32(votes, high), votes));
+        unsigned int laneMask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(inRange, loadMask))) & ((liveMask >> i) & 0xFF);
+        if (laneMask == 0) continue;
+        matches |= laneMask << i;
+
+        __m256i sumMask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(laneMask), laneBits), laneBits);
+        if (IS_PACKED) {
+            // the rating is already in the word that was loaded
+            sumOfRatingTenths = _mm256_add_epi32(sumOfRatingTenths, _mm256_and_si256(_mm256_srli_epi32(words, COMPACT_VOTES_BITS), sumMask));
+            continue;
+        }
+
+        __m256 ratings;
+        if (isContiguous) {
+            ratings = _mm256_maskload_ps((const float*)averageRatings + i, sumMask);
+        } else {
+            ratings = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), (const float*)averageRatings, offsets, _mm256_castsi256_ps(sumMask), 1);
+        }
+        sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_castps256_ps128(ratings)));
+        sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_extractf128_ps(ratings, 1)));
+    }
+
+    if (IS_PACKED) {
+        unsigned int tenths[8];
+        _mm256_storeu_si256((__m256i*)tenths, sumOfRatingTenths);
+        unsigned int totalTenths = 0;
+        for (int lane = 0; lane < 8; lane++) totalTenths += tenths[lane];
+        sumOfAverageRating += totalTenths / 10.0;
+        return matches;
+    }
+    double lanesSum[4];
+    _mm256_storeu_pd(lanesSum, sum);
+    sumOfAverageRating += (lanesSum[0] + lanesSum[1]) + (lanesSum[2] + lanesSum[3]);
+    return matches;
+}
+
+#endif
+
+ScanKernel::ScanKernel()
+{
+    name = "scalar";
+    filterImpl = filterScalar<false>;
+    filterPackedImpl = filterScalar<true>;
+#ifdef SCAN_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        name = "AVX2";
+        filterImpl = filterAVX2<false>;
+        filterPackedImpl = filterAVX2<true>;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        name = "SSE4.1";
+        filterImpl = filterSSE<false>;
+        filterPackedImpl = filterSSE<true>;
+    }
+#endif
+}
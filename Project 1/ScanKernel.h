@@ -0,0 +1,42 @@
+#ifndef SCANKERNEL_H
+#define SCANKERNEL_H
+
+#include "structures.h"
+
+// Filters the records of a data block on a numVotes range and sums the averageRating of the matches in one pass
+// The attributes are addressed by a pointer to the first record's value and a byte stride between records,
+// so the same kernel serves PAX minipages (stride 4) and row-wise records (stride -sizeof(movieRecord))
+// Compact records keep averageRating and numVotes packed in one word, filterPacked() decodes them on the fly
+// The widest implementation the CPU supports (AVX2, SSE4.1 or scalar) is picked once when the kernel is created
+class ScanKernel
+{
+    public:
+    // Up to this many records are filtered by a single call, one bit of the liveMask/result each
+    static constexpr int MAX_RECORDS_PER_CALL = 32;
+
+    typedef unsigned int (*filterFunction)(const char* numVotes, const char* averageRatings, int stride, int numRecords,
+        unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating);
+
+    const char* name; // name of the chosen implementation, for reporting
+    filterFunction filterImpl;
+    filterFunction filterPackedImpl;
+
+    ScanKernel();
+
+    // Returns a bitmask of the records i < numRecords that are set in liveMask and have numVotesStart <= numVotes <= numVotesEnd,
+    // adding their averageRating to sumOfAverageRating
+    unsigned int filter(const char* numVotes, const char* averageRatings, int stride, int numRecords,
+        unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating)
+    {
+        return filterImpl(numVotes, averageRatings, stride, numRecords, liveMask, numVotesStart, numVotesEnd, sumOfAverageRating);
+    }
+
+    // Same as filter(), for compactRecord ratingAndVotes words starting at ratingAndVotes
+    unsigned int filterPacked(const char* ratingAndVotes, int stride, int numRecords,
+        unsigned int liveMask, unsigned int numVotesStart, unsigned int numVotesEnd, double &sumOfAverageRating)
+    {
+        return filterPackedImpl(ratingAndVotes, ratingAndVotes, stride, numRecords, liveMask, numVotesStart, numVotesEnd, sumOfAverageRating);
+    }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "ZoneMap.h"
+#include <climits>
+#include <cfloat>
+
+void ZoneMap::addRecord(int blockId, unsigned int numVotes, float averageRating)
+{
+    if (blockId >= (int)entries.size()) {
+        entries.resize(blockId + 1, {UINT_MAX, 0, FLT_MAX, -FLT_MAX});
+    }
+    zoneMapEntry &entry = entries[blockId];
+    if (numVotes < entry.minNumVotes) entry.minNumVotes = numVotes;
+    if (numVotes > entry.maxNumVotes) entry.maxNumVotes = numVotes;
+    if (averageRating < entry.minAverageRating) entry.minAverageRating = averageRating;
+    if (averageRating > entry.maxAverageRating) entry.maxAverageRating = averageRating;
+}
+
+void ZoneMap::resetBlock(int blockId)
+{
+    if (blockId < (int)entries.size()) {
+        entries[blockId] = {UINT_MAX, 0, FLT_MAX, -FLT_MAX};
+    }
+}
+
+bool ZoneMap::isOnEdge(int blockId, unsigned int numVotes, float averageRating)
+{
+    zoneMapEntry &entry = entries[blockId];
+    return numVotes == entry.minNumVotes || numVotes == entry.maxNumVotes
+        || averageRating == entry.minAverageRating || averageRating == entry.maxAverageRating;
+}
+
+// Blocks beyond the end of entries have never held a record
+bool ZoneMap::mayContainNumVotes(int blockId, unsigned int numVotesStart, unsigned int numVotesEnd)
+{
+    if (blockId >= (int)entries.size()) return false;
+    return entries[blockId].minNumVotes <= numVotesEnd && entries[blockId].maxNumVotes >= numVotesStart;
+}
+
+bool ZoneMap::mayContainAverageRating(int blockId, float averageRatingStart, float averageRatingEnd)
+{
+    if (blockId >= (int)entries.size()) return false;
+    return entries[blockId].minAverageRating <= averageRatingEnd && entries[blockId].maxAverageRating >= averageRatingStart;
+}
@@ -0,0 +1,38 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <vector>
+
+using namespace std;
+
+// Smallest and largest numVotes and averageRating of the records in a data block
+// A block without records has minNumVotes > maxNumVotes, so it never matches a range
+struct zoneMapEntry
+{
+    unsigned int minNumVotes;
+    unsigned int maxNumVotes;
+    float minAverageRating;
+    float maxAverageRating;
+};
+
+// Keeps a zoneMapEntry for every data block, so scans can skip blocks that cannot hold a matching record
+// Inserting widens a block's entry, deleting a record at the edge of a range requires the entry to be rebuilt
+// from the remaining records (resetBlock() followed by addRecord() for each of them)
+class ZoneMap
+{
+    public:
+    vector<zoneMapEntry> entries; // indexed by block id
+
+    // Widens the entry of a block to include a record
+    void addRecord(int blockId, unsigned int numVotes, float averageRating);
+    // Empties the entry of a block
+    void resetBlock(int blockId);
+    // Returns true if a record was at the edge of a block's entry, i.e. the entry may shrink once it is deleted
+    bool isOnEdge(int blockId, unsigned int numVotes, float averageRating);
+
+    // Return false only if no record of the block can be in the range
+    bool mayContainNumVotes(int blockId, unsigned int numVotesStart, unsigned int numVotesEnd);
+    bool mayContainAverageRating(int blockId, float averageRatingStart, float averageRatingEnd);
+};
+
+#endif
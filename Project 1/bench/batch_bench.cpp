@@ -0,0 +1,68 @@
+// Benchmark of the B+ Tree's batched lookup, findRecordsBatch(), against looking the same keys up one by one
+// Build from "Project 1" (it is not part of the DBMS program):
+//   g++ -O2 -std=c++17 -pthread bench/batch_bench.cpp BPlusTree.cpp BPlusTreeCursor.cpp BufferPool.cpp DiskSimulator.cpp -o batch_bench
+// Usage: ./batch_bench [numKeys] [numProbes]
+
+#include "../BPlusTree.h"
+#include "../BufferPool.h"
+#include "../DiskSimulator.h"
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    unsigned int numKeys = argc > 1 ? atoi(argv[1]) : 1000000;
+    unsigned int numProbes = argc > 2 ? atoi(argv[2]) : 2000000;
+
+    // Keys are drawn from twice as many values as there are records, so some keys have duplicates and some are missing
+    // Every record has its own recordID, and at worst every record takes a 200B node of its own
+    // The block ids of the entries are never read, and the buffer pool holds about a quarter of the nodes
+    DiskSimulator disk(100 + (int)(numKeys * 200.0 / 1000000), 200);
+    BufferPool pool(&disk, numKeys / 4 + 1024);
+    BPlusTree tree(200, &disk, &pool, disk.createSegment());
+    mt19937 random(1);
+    vector<pair<unsigned int, pointerBlockPair>> records;
+    for (unsigned int i = 0; i < numKeys; i++) {
+        records.push_back({(unsigned int)(random() % (numKeys * 2)), {(int)i, (int)i, 0, RATING_NOT_INCLUDED}});
+    }
+    tree.bulkLoad(records, 1.0);
+    printf("B+ Tree of %u keys, height %u, %u nodes, %u overflow nodes\n\n", numKeys, tree.height, tree.numNodes, tree.numOverflowNodes);
+
+    vector<unsigned int> probes;
+    for (unsigned int i = 0; i < numProbes; i++) {
+        probes.push_back(random() % (numKeys * 2));
+    }
+
+    // findRecord() does not print its statistics to a closed stream
+    ofstream noOutput;
+    unsigned long oneByOneEntries = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (unsigned int numVotes : probes) {
+        oneByOneEntries += tree.findRecord(numVotes, numVotes, noOutput).size();
+    }
+    chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+    vector<vector<pointerBlockPair>> batchResults = tree.findRecordsBatch(probes);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    printf("%u probes, %lu entries found\n", numProbes, oneByOneEntries);
+    printf("One by one: %10.1f ms\n", chrono::duration<double, milli>(middle - start).count());
+    printf("Batched:    %10.1f ms\n", chrono::duration<double, milli>(end - middle).count());
+
+    // Every key must get the same entries, in the same order, as findRecord() gives it
+    long numErrors = batchResults.size() != probes.size();
+    for (size_t i = 0; i < probes.size() && i < batchResults.size(); i++) {
+        list<pointerBlockPair> expected = tree.findRecord(probes[i], probes[i], noOutput);
+        if (expected.size() != batchResults[i].size()) {
+            numErrors++;
+            continue;
+        }
+        size_t j = 0;
+        for (pointerBlockPair &entry : expected) {
+            if (entry.blockId != batchResults[i][j].blockId || entry.recordID != batchResults[i][j].recordID) numErrors++;
+            j++;
+        }
+    }
+    printf("\n%ld wrong results\n", numErrors);
+    return numErrors > 0;
+}
@@ -0,0 +1,165 @@
+// Multi-threaded stress test and benchmark of the B+ Tree's concurrent access
+// Build from "Project 1" (it is not part of the DBMS program):
+//   g++ -O2 -std=c++17 -pthread bench/concurrent_bench.cpp BPlusTree.cpp BPlusTreeCursor.cpp BufferPool.cpp DiskSimulator.cpp -o concurrent_bench
+// Usage: ./concurrent_bench [numKeys] [secondsPerRun] [maxThreads]
+
+#include "../BPlusTree.h"
+#include "../BufferPool.h"
+#include "../DiskSimulator.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+// Keys 0, 2, 4, ... are bulk loaded, odd keys are inserted by the writers and multiples of 4 are removed by the remover
+// Every key k has a single record whose recordID is k, the block ids of the entries are never read
+pointerBlockPair entryOf(unsigned int key) {
+    return {(int)key, (int)key, 0, 0};
+}
+
+// Looks up random loaded keys that are never removed until stop is set, counting the lookups and the wrong results
+void lookUpKeys(BPlusTree* tree, unsigned int numKeys, int seed, atomic<bool> &stop, long &numLookups, long &numErrors) {
+    mt19937 random(seed);
+    vector<pointerBlockPair> entries;
+    while (!stop.load(memory_order_relaxed)) {
+        for (int i = 0; i < 256; i++) {
+            unsigned int key = random() % (numKeys / 2) * 4 + 2;
+            entries.clear();
+            tree->findRange(key, key, entries);
+            if (entries.size() != 1 || entries[0].recordID != (int)key) numErrors++;
+        }
+        numLookups += 256;
+    }
+}
+
+// Runs numReaders lookup threads for the given time, while numWriters threads insert odd keys below maxOddKey
+// and, if withRemover is set, one thread removes the loaded multiples of 4 below maxRemovedKey
+// Returns the number of lookups per second, and adds the wrong results to numErrors
+double runLookups(BPlusTree* tree, unsigned int numKeys, int numReaders, int numWriters, bool withRemover, double seconds,
+    atomic<unsigned int> &nextOddKey, unsigned int maxOddKey, atomic<unsigned int> &nextRemovedKey, unsigned int maxRemovedKey, long &numErrors) {
+    atomic<bool> stop(false);
+    vector<long> numLookups(numReaders * 16, 0), readerErrors(numReaders * 16, 0); // a cache line apart
+    vector<thread> threads;
+    for (int r = 0; r < numReaders; r++) {
+        threads.emplace_back(lookUpKeys, tree, numKeys, r + 1, ref(stop), ref(numLookups[r * 16]), ref(readerErrors[r * 16]));
+    }
+    for (int w = 0; w < numWriters; w++) {
+        threads.emplace_back([&]() {
+            while (!stop.load(memory_order_relaxed)) {
+                unsigned int key = nextOddKey.fetch_add(2);
+                if (key >= maxOddKey) break;
+                tree->insertRecord(key, entryOf(key));
+            }
+        });
+    }
+    if (withRemover) {
+        threads.emplace_back([&]() {
+            while (!stop.load(memory_order_relaxed)) {
+                unsigned int key = nextRemovedKey.fetch_add(4);
+                if (key >= maxRemovedKey) break;
+                tree->removeKey(key);
+            }
+        });
+    }
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (thread &t : threads) t.join();
+
+    long totalLookups = 0;
+    for (int r = 0; r < numReaders; r++) {
+        totalLookups += numLookups[r * 16];
+        numErrors += readerErrors[r * 16];
+    }
+    return totalLookups / seconds;
+}
+
+// Checks that the leaves hold every key in order, with the right record, that the inserted odd keys are all there
+// and that the removed keys are gone
+long checkTree(BPlusTree* tree, unsigned int numKeys, unsigned int lastOddKey, unsigned int lastRemovedKey) {
+    long numErrors = 0;
+    vector<pointerBlockPair> entries;
+    tree->findRange(0, ~0u, entries);
+    unsigned int expectedKeys = numKeys + (lastOddKey - 1) / 2 - lastRemovedKey / 4;
+    if (entries.size() != expectedKeys) numErrors++;
+
+    long previous = -1;
+    for (pointerBlockPair &entry : entries) {
+        if (entry.recordID <= previous) numErrors++;
+        previous = entry.recordID;
+    }
+    for (unsigned int key = 1; key < lastOddKey; key += 2) {
+        entries.clear();
+        tree->findRange(key, key, entries);
+        if (entries.size() != 1 || entries[0].recordID != (int)key) numErrors++;
+    }
+    for (unsigned int key = 0; key < lastRemovedKey; key += 4) {
+        entries.clear();
+        tree->findRange(key, key, entries);
+        if (!entries.empty()) numErrors++;
+    }
+    return numErrors;
+}
+
+int main(int argc, char** argv) {
+    unsigned int numKeys = argc > 1 ? atoi(argv[1]) : 1000000;
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    int maxThreads = argc > 3 ? atoi(argv[3]) : max(1u, thread::hardware_concurrency());
+
+    // The writers insert up to 64 keys per loaded key, nodes are 200B and at least half full
+    // The disk is only touched as it is used, so sizing it for the worst case is cheap
+    unsigned int maxOddKey = numKeys * 128 + 1;
+    unsigned int maxRemovedKey = (numKeys * 2 + 3) / 4 * 4;
+    DiskSimulator disk(100 + (int)(numKeys * 65.0 / 4 * 200 / 1000000), 200);
+    BufferPool pool(&disk, 1 << 16);
+    BPlusTree tree(200, &disk, &pool, disk.createSegment());
+    vector<pair<unsigned int, pointerBlockPair>> records;
+    for (unsigned int i = 0; i < numKeys; i++) {
+        records.push_back({i * 2, entryOf(i * 2)});
+    }
+    tree.bulkLoad(records, 0.7);
+    printf("B+ Tree of %u keys, height %u, %u nodes\n\n", numKeys, tree.height, tree.numNodes);
+
+    atomic<unsigned int> nextOddKey(1), nextRemovedKey(0);
+    long numErrors = 0;
+    double singleThread = 0;
+
+    printf("Lookups only\n%8s %16s %8s\n", "threads", "lookups/s", "speedup");
+    for (int numReaders = 1; numReaders <= maxThreads; numReaders *= 2) {
+        double lookupsPerSecond = runLookups(&tree, numKeys, numReaders, 0, false, seconds, nextOddKey, maxOddKey, nextRemovedKey, maxRemovedKey, numErrors);
+        if (numReaders == 1) singleThread = lookupsPerSecond;
+        printf("%8d %16.0f %8.2f\n", numReaders, lookupsPerSecond, lookupsPerSecond / singleThread);
+    }
+
+    printf("\nLookups with 1 thread inserting\n%8s %16s %12s\n", "readers", "lookups/s", "inserts");
+    for (int numReaders = 1; numReaders <= max(1, maxThreads - 1); numReaders *= 2) {
+        unsigned int insertsBefore = min(nextOddKey.load(), maxOddKey);
+        double lookupsPerSecond = runLookups(&tree, numKeys, numReaders, 1, false, seconds, nextOddKey, maxOddKey, nextRemovedKey, maxRemovedKey, numErrors);
+        printf("%8d %16.0f %12u\n", numReaders, lookupsPerSecond, (min(nextOddKey.load(), maxOddKey) - insertsBefore) / 2);
+    }
+
+    printf("\nInserts only\n%8s %16s\n", "threads", "inserts/s");
+    for (int numWriters = 1; numWriters <= maxThreads; numWriters *= 2) {
+        unsigned int insertsBefore = min(nextOddKey.load(), maxOddKey);
+        runLookups(&tree, numKeys, 0, numWriters, false, seconds, nextOddKey, maxOddKey, nextRemovedKey, maxRemovedKey, numErrors);
+        printf("%8d %16.0f\n", numWriters, (min(nextOddKey.load(), maxOddKey) - insertsBefore) / 2 / seconds);
+    }
+
+    printf("\nLookups and inserts with 1 thread removing\n%8s %16s %12s %12s\n", "readers", "lookups/s", "inserts", "removals");
+    for (int numReaders = 1; numReaders <= max(1, maxThreads - 2); numReaders *= 2) {
+        unsigned int insertsBefore = min(nextOddKey.load(), maxOddKey);
+        unsigned int removalsBefore = min(nextRemovedKey.load(), maxRemovedKey);
+        double lookupsPerSecond = runLookups(&tree, numKeys, numReaders, 1, true, seconds, nextOddKey, maxOddKey, nextRemovedKey, maxRemovedKey, numErrors);
+        printf("%8d %16.0f %12u %12u\n", numReaders, lookupsPerSecond, (min(nextOddKey.load(), maxOddKey) - insertsBefore) / 2,
+            (min(nextRemovedKey.load(), maxRemovedKey) - removalsBefore) / 4);
+    }
+
+    unsigned int lastOddKey = min(nextOddKey.load(), maxOddKey);
+    if (lastOddKey == maxOddKey) printf("\nThe writers ran out of keys to insert, the insert rates above are too low\n");
+    unsigned int lastRemovedKey = min(nextRemovedKey.load(), maxRemovedKey);
+    if (lastRemovedKey == maxRemovedKey) printf("The remover ran out of keys to remove, the later runs had no removals\n");
+    numErrors += checkTree(&tree, numKeys, lastOddKey, lastRemovedKey);
+    printf("\n%ld wrong results, %u keys in the tree, height %u\n", numErrors, numKeys + (lastOddKey - 1) / 2 - lastRemovedKey / 4, tree.height);
+    return numErrors == 0 ? 0 : 1;
+}
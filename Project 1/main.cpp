@@ -1,6 +1,7 @@
 #include "DBMS.h"
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
 
 void displayOptions() {
   cout << "1) Run Experiment 1\n"
@@ -8,10 +9,21 @@ void displayOptions() {
           "3) Run Experiment 3\n"
           "4) Run Experiment 4\n"
           "5) Run Experiment 5\n"
-          "6) Exit program\n";
+          "6) Find a movie by its tconst\n"
+          "7) Find movies by averageRating and numVotes ranges\n"
+          "8) Exit program\n";
 }
 
-int main()
+// Usage: ./DBMS [--disk diskFile] [--frames bufferFrames] [--layout row|pax] [--encoding plain|compact] [--index plain|covering] [--organization heap|clustered] [--fill fillFactor] [--threads scanThreads]
+// --disk: memory map the disk from diskFile, reopening a previously loaded database if the file holds one
+// --frames: number of blocks (data blocks, hash buckets and B+ tree nodes) the buffer pool can hold, at least 64
+// --layout: store records row-wise (default) or in PAX minipages within each data block
+// --encoding: store records as they are (default) or in the compact encoding (integer tconst, packed rating and numVotes)
+// --index: covering includes averageRating in the B+ tree leaves, so Experiments 3 and 4 read no data blocks
+// --organization: insert records wherever there is room (default) or keep the data blocks in numVotes order
+// --fill: fraction (0.5 to 1) of every B+ tree node filled when the tree is built by Experiment 1, or on reopening a disk whose tree was not saved, 1 by default
+// --threads: number of threads (1 to 1024) used by the brute-force scans, all hardware threads by default
+int main(int argc, char* argv[])
 {
     int choice;
     char choice_5;
@@ -22,12 +34,79 @@ int main()
     ofstream exp3Output;
     ofstream exp4Output;
     ofstream exp5Output;
+    ofstream lookupOutput;
+    ofstream ratingOutput;
+    string tconst;
+    float averageRatingStart, averageRatingEnd;
+    unsigned int numVotesStart, numVotesEnd;
 
     const unsigned int blockSize = 200;
+    // A change to the B+ tree's structure keeps the nodes it latched pinned until it is done,
+    // next to the data block and hash index bucket of the insertion
+    const int minBufferFrames = 64;
     // Using disk capacity of 100MB
     unsigned int diskSize = 100;
     string resultsDir = "results/";;
-    dbms = new DBMS(diskSize, blockSize);
+    const char* diskFile = nullptr;
+    unsigned int bufferFrames = 1024;
+    blockLayout layout = ROW_LAYOUT;
+    bool compactRecords = false;
+    bool coveringIndex = false;
+    bool clustered = false;
+    float fillFactor = 1.0;
+    int scanThreads = 0;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            cout << "Missing value for option " << argv[i] << endl;
+            return 1;
+        } else if (strcmp(argv[i], "--disk") == 0) {
+            diskFile = argv[i+1];
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            if (atoi(argv[i+1]) < minBufferFrames) {
+                cout << "The buffer pool needs at least " << minBufferFrames << " frames" << endl;
+                return 1;
+            }
+            bufferFrames = atoi(argv[i+1]);
+        } else if (strcmp(argv[i], "--layout") == 0 && strcmp(argv[i+1], "row") == 0) {
+            layout = ROW_LAYOUT;
+        } else if (strcmp(argv[i], "--layout") == 0 && strcmp(argv[i+1], "pax") == 0) {
+            layout = PAX_LAYOUT;
+        } else if (strcmp(argv[i], "--encoding") == 0 && strcmp(argv[i+1], "plain") == 0) {
+            compactRecords = false;
+        } else if (strcmp(argv[i], "--encoding") == 0 && strcmp(argv[i+1], "compact") == 0) {
+            compactRecords = true;
+        } else if (strcmp(argv[i], "--index") == 0 && strcmp(argv[i+1], "plain") == 0) {
+            coveringIndex = false;
+        } else if (strcmp(argv[i], "--index") == 0 && strcmp(argv[i+1], "covering") == 0) {
+            coveringIndex = true;
+        } else if (strcmp(argv[i], "--organization") == 0 && strcmp(argv[i+1], "heap") == 0) {
+            clustered = false;
+        } else if (strcmp(argv[i], "--organization") == 0 && strcmp(argv[i+1], "clustered") == 0) {
+            clustered = true;
+        } else if (strcmp(argv[i], "--fill") == 0) {
+            char* end;
+            fillFactor = strtof(argv[i+1], &end);
+            if (*end != '\0' || !(fillFactor >= 0.5 && fillFactor <= 1)) {
+                cout << "The fill factor must be a number from 0.5 to 1" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            char* end;
+            long threads = strtol(argv[i+1], &end, 10);
+            if (*end != '\0' || threads < 1 || threads > 1024) {
+                cout << "The number of threads must be a whole number from 1 to 1024" << endl;
+                return 1;
+            }
+            scanThreads = threads;
+        } else {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+    dbms = new DBMS(diskSize, blockSize, diskFile, bufferFrames, layout, compactRecords, coveringIndex, clustered, fillFactor);
+    if (scanThreads > 0) {
+        dbms->SCAN_THREADS = scanThreads;
+    }
     
     do {
         // Display the options list
@@ -57,19 +136,23 @@ int main()
                 // The number of records stored in a block
                 // The number of blocks for storing the data
                 cout << "-----Running Experiment 1-----" <<endl;  
-                dbms->importData("data.tsv");
+                if (dbms->disk->isReopened) {
+                    cout << "Database already loaded from " << diskFile << ", skipping import" << endl;
+                } else {
+                    dbms->importData("data.tsv");
+                }
                 exp1Output.open(resultsDir + "experiment_1.txt");
 
                 // Write output to file
                 exp1Output << "Number of records: " << dbms->numRecords << endl;
-                exp1Output << "Size of a record: " << (sizeof(movieRecord)) << "-Byte" << endl;
-                exp1Output << "Number of records stored in a block: " << ceil((blockSize - sizeof(unsigned int))/ (sizeof(movieRecord) + sizeof(indexMapping))) << endl; 
+                exp1Output << "Size of a record: " << dbms->RECORD_SIZE << "-Byte" << endl;
+                exp1Output << "Number of records stored in a block: " << dbms->MAX_RECORDS << endl; 
                 exp1Output << "Number of blocks for storing the data: " << dbms->numBlocks << endl;
 
                 // print to screen
                 // cout << "Number of records: " <<  dbms->numRecords << endl; // Already printed when import data
-                cout << "Size of a record: " << (sizeof(movieRecord)) << "-Byte" << endl;
-                cout << "Number of records stored in a block: " << ceil((blockSize - sizeof(unsigned int))/ (sizeof(movieRecord) + sizeof(indexMapping))) << endl;
+                cout << "Size of a record: " << dbms->RECORD_SIZE << "-Byte" << endl;
+                cout << "Number of records stored in a block: " << dbms->MAX_RECORDS << endl;
                 cout << "Number of blocks for storing the data: " << dbms->numBlocks << endl;
                 exp1Output.close();
                 break;
@@ -97,7 +180,7 @@ int main()
                 cout << "\n=====Content of root=====" << endl;
                 cout << "Root: \n";
                 exp2Output << "Root: \n";
-                dbms->bPlusTree->printIndexBlock(dbms->bPlusTree->root, exp2Output);
+                dbms->bPlusTree->printRoot(exp2Output);
                 exp2Output.close();
                 break;  
             case 3:
@@ -162,7 +245,7 @@ int main()
                             cout << "\n=====Content of root and first child=====" << endl;
 
                             // print to screen and write to file
-                            dbms->bPlusTree->printIndexBlock(dbms->bPlusTree->root, exp5Output);
+                            dbms->bPlusTree->printRoot(exp5Output);
                             break;
                         
                         case('b'):
@@ -178,6 +261,29 @@ int main()
                 exp5Output.close();
                 break;
             case 6:
+                // Point lookup of a movie by its tconst through the hash index, reporting the index and data blocks it reads
+                cout << "-----Finding a movie by its tconst-----" <<endl;
+                cout << "Enter the tconst: ";
+                cin >> tconst;
+                lookupOutput.open(resultsDir + "tconst_lookup.txt", ios::app);
+                lookupOutput << "tconst: " << tconst << "\n";
+                dbms->findRecordByTconst(tconst.c_str(), lookupOutput);
+                lookupOutput.close();
+                break;
+            case 7:
+                // Combined range query answered with the averageRating bitmap index ANDed with the B+ tree's numVotes range
+                cout << "-----Finding movies by averageRating and numVotes ranges-----" <<endl;
+                cout << "Enter the averageRating range (from to): ";
+                cin >> averageRatingStart >> averageRatingEnd;
+                cout << "Enter the numVotes range (from to): ";
+                cin >> numVotesStart >> numVotesEnd;
+                ratingOutput.open(resultsDir + "rating_query.txt", ios::app);
+                ratingOutput << "averageRating " << averageRatingStart << " to " << averageRatingEnd
+                    << ", numVotes " << numVotesStart << " to " << numVotesEnd << "\n";
+                dbms->findRecordsByRating(averageRatingStart, averageRatingEnd, numVotesStart, numVotesEnd, ratingOutput);
+                ratingOutput.close();
+                break;
+            case 8:
                 cout << "Exiting...";
                 break;
             default:
@@ -187,7 +293,8 @@ int main()
         // Add a line break for readability
         cout << endl;
 
-    } while(choice != 6);
+    } while(choice != 8);
 
+    delete dbms;
     return 0;
 }
\ No newline at end of file
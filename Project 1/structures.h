@@ -1,6 +1,7 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include <cstdint>
 
 // The Data Structure for storing a movie record
 // Fields:
@@ -18,32 +19,107 @@ struct movieRecord
     unsigned int numVotes;  // 4 bytes
 };
 
-// Used within a block to map the recordID to its position in the block
-// Position is determined from the end
-// For example, a record with ID 42, located as the last record in the block
-// would be {42, 0}
-struct indexMapping
+// Compact encoding of a movieRecord, used when the DBMS is created with compact records
+// tconst: the digits after "tt" as an integer, written back as at least 7 digits, e.g. "tt0000001" is 1
+// ratingAndVotes: averageRating*10 in the top 7 bits, numVotes in the low 25 bits
+// Records whose values do not fit (e.g. more than 2^25-1 votes) cannot be stored in this encoding
+const int COMPACT_VOTES_BITS = 25;
+const unsigned int COMPACT_VOTES_MASK = (1u << COMPACT_VOTES_BITS) - 1;
+struct compactRecord // 12 bytes
 {
-    unsigned int recordID; 
-    int indexOfRecord; // -1 represents a deleted record in block
+    unsigned int recordID;
+    unsigned int tconst;
+    unsigned int ratingAndVotes;
+};
+
+// How records are laid out inside a data block, chosen when the DBMS is created
+// ROW_LAYOUT: whole movieRecords are stored one after another from the end of the block
+// PAX_LAYOUT: each attribute is stored in its own minipage (recordID, averageRating, numVotes, tconst columns),
+//             so scans only bring the attributes they use into the cache
+// With compact records, PAX blocks hold recordID, ratingAndVotes and tconst minipages
+enum blockLayout
+{
+    ROW_LAYOUT,
+    PAX_LAYOUT
+};
+
+// Stored at the start of every data block, followed by the presence bitmap
+// Records are fixed-length, so a block is an array of record slots and the slot of a record is its position:
+// for ROW_LAYOUT, position is determined from the end, for PAX_LAYOUT it is the index into every minipage
+// Bit i of the presence bitmap (bit i%32 of word i/32) is set if slot i holds a record, deleting a record clears its bit
+struct dataBlockHeader // 4 bytes
+{
+    unsigned int numRecords; // number of records currently in the block
 };
 
 // Used as our pointer structure in B+ tree
-// For leaf nodes, blockAddress means address of the data block it points to
-// For non-leaf nodes, blockAddress means address of the index block it points to
-struct pointerBlockPair // 8 bytes
+// For leaf nodes, blockId means id of the data block it points to
+// and slot is the position of the record in that block, so (blockId, slot) locates the record directly
+// With a covering index, leaf and overflow entries also include the record's averageRating (in tenths),
+// so queries that only need averageRating do not have to read the data block
+// For non-leaf nodes, blockId means id of the index block it points to
+// Block ids stay valid when the disk is reopened, so the nodes can be kept on disk, -1 means no block
+const unsigned short RATING_NOT_INCLUDED = 0xFFFF;
+struct pointerBlockPair // 12 bytes
 {
-    void* blockAddress;
+    int blockId;
     int recordID; // -1 indicates an overflow, any positive indicates the a duplicated record
+    unsigned short slot;
+    unsigned short averageRatingTenths; // RATING_NOT_INCLUDED if the index is not covering or the rating is not a multiple of 0.1
+};
+
+
+// Stored at the start of every bucket block of the tconst hash index, followed by the bucket's hashIndexEntries
+// A bucket holds the keys whose hash ends in the localDepth bits hashBits, it continues in overflow blocks
+// only when its keys cannot be told apart by more hash bits (e.g. the same tconst inserted more than once)
+struct hashBucketHeader // 16 bytes
+{
+    unsigned int numEntries;
+    unsigned short localDepth;
+    unsigned short isOverflow; // 1 for the overflow blocks of a bucket, 0 for the first block
+    unsigned int hashBits;
+    int nextBlockId; // next overflow block of the bucket, -1 if this is the last one
 };
 
+// Stored in the first block of the hash index's segment, before every bucket block
+// isClosed is set only while no DBMS has the index open, a disk whose last run did not close it has its index rebuilt
+struct hashIndexHeader
+{
+    char magic[8];
+    int isClosed;
+};
+
+// Entry of the tconst hash index, locates a record by the id of its data block and its slot
+// Only the hash of tconst is kept, the record's tconst is compared once its data block is read
+struct hashIndexEntry // 16 bytes
+{
+    unsigned int tconstHash;
+    unsigned int recordID;
+    int blockId;
+    unsigned int slot;
+};
 
 // Used to store relevant header information for a node in the B+ tree
-struct NodeHeader // 14->16 (padded) bytes, multiple of 4
+struct NodeHeader // 32 bytes (padded)
 {
     unsigned int numKeys;
     pointerBlockPair pointerToParent;
     bool isLeaf;
+    uint64_t version; // latch of the node for concurrent access, see BPlusTree::readLock()
+};
+
+// Stored in the first block of the B+ Tree's index segment, so that the tree of a reopened disk can be used as it is
+// isClosed is set only while no DBMS has the tree open, a disk whose last run did not close it has its tree rebuilt
+struct bPlusTreeHeader
+{
+    char magic[8];
+    unsigned int maxKeys;
+    int rootId;
+    unsigned int height;
+    unsigned int numNodes;
+    unsigned int numOverflowNodes;
+    int freeNodes;  // first node of the free list, -1 if it is empty
+    int isClosed;
 };
 
 #endif
\ No newline at end of file